@@ -23,6 +23,7 @@
 #include <boost/process.hpp>
 
 #include "gui.h"
+#include "util.h"
 #include "stream.h"
 #include "renderer.h"
 #include "worker_thread.h"
@@ -218,7 +219,7 @@ void app::run_emulator() {
 		return;
 	}
 	
-	_project->iso.commit(); // Recompress WAD segments.
+	_project->iso.commit(default_num_threads()); // Recompress WAD segments.
 	
 	if(boost::filesystem::is_regular_file(settings.emulator_path)) {
 		std::string emulator_path = boost::filesystem::canonical(settings.emulator_path).string();
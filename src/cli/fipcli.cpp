@@ -29,7 +29,7 @@ int main(int argc, char** argv) {
 	return run_cli_converter(argc, argv,
 		"Converts indexed colour textures in the FIP format to BMP files",
 		{
-			{ "export", fip_to_bmp },
-			{ "import", bmp_to_fip }
+			{ "export", { fip_to_bmp, ".bmp" } },
+			{ "import", { bmp_to_fip, ".fip" } }
 		});
 }
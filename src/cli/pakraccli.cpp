@@ -16,13 +16,16 @@
 	along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <mutex>
+#include <iomanip>
 #include <sstream>
 #include <iostream>
 #include <boost/filesystem.hpp>
 
 #include "../util.h"
+#include "../disc_catalogue.h"
 #include "../command_line.h"
-#include "../formats/fip.h"
 #include "../formats/wad.h"
 #include "../formats/racpak.h"
 
@@ -32,25 +35,41 @@ namespace fs = boost::filesystem;
 #	CLI tool to inspect, unpack and repack .WAD archives (racpaks).
 # */
 
-void extract_archive(std::string dest_dir, racpak& archive);
-void scan_for_archives(std::string src_path);
+struct extract_job {
+	std::string src_path;
+	std::size_t offset; // Of the racpak within the source file.
+	std::string dest_dir;
+};
+
+void extract_archives(std::vector<extract_job> jobs, bool decompress, std::size_t num_threads);
+void pack_archive(std::string dest_path, std::string src_dir, bool compress, std::size_t num_threads);
+void scan_for_archives(std::string src_path, std::size_t num_threads);
 
 int main(int argc, char** argv) {
 	std::string command;
 	std::string src_path;
 	std::string dest_path;
 	std::string src_offset_str;
+	bool compress = false;
+	bool decompress = false;
+	std::size_t num_threads;
 
 	po::options_description desc("Read a game archive file");
 	desc.add_options()
 		("command,c", po::value<std::string>(&command)->required(),
-			"The operation to perform. Available commands are: ls, extract, extractdir.")
+			"The operation to perform. Available commands are: ls, extract, extractdir, pack, scan.")
 		("src,s", po::value<std::string>(&src_path)->required(),
 			"The input file of directory.")
 		("dest,d", po::value<std::string>(&dest_path),
 			"The output file or directory (if applicable).")
 		("offset,o", po::value<std::string>(&src_offset_str)->default_value("0"),
-			"The offset of the racpak within the source file. Only applicable when in extract mode (not extractdir).");
+			"The offset of the racpak within the source file. Only applicable when in extract mode (not extractdir).")
+		("decompress", po::bool_switch(&decompress),
+			"Decompress WAD compressed entries while extracting. Only applicable when in extract or extractdir mode.")
+		("compress", po::bool_switch(&compress),
+			"WAD compress entries that aren't already compressed. Only applicable when in pack mode.")
+		("jobs,j", po::value<std::size_t>(&num_threads)->default_value(default_num_threads()),
+			"The maximum number of threads to use.");
 
 	po::positional_options_description pd;
 	pd.add("command", 1);
@@ -76,101 +95,226 @@ int main(int argc, char** argv) {
 			std::cout << entry.size << "\n";
 		}
 	} else if(command == "extract") {
-		file_stream src_file(src_path);
-		racpak archive(&src_file, parse_number(src_offset_str), src_file.size());
-		
 		if(dest_path == "") {
 			std::cerr << "Must specify destination.\n";
 			return 0;
 		}
-		extract_archive(dest_path, archive);
+		extract_archives({ { src_path, parse_number(src_offset_str), dest_path } }, decompress, num_threads);
 	} else if(command == "extractdir") {
 		if(dest_path == "") {
 			std::cerr << "Must specify destination.\n";
 			return 0;
 		}
+		std::vector<extract_job> jobs;
 		auto begin = fs::directory_iterator(src_path);
 		auto end = fs::directory_iterator();
 		for(auto iter = begin; iter != end; iter++) {
 			auto path = iter->path();
-			
-			file_stream src_file(path.string());
-			racpak archive(&src_file, 0, src_file.size());
-			
+			if(!fs::is_regular_file(path)) {
+				continue;
+			}
 			std::string dest_dir = dest_path + "/" + path.filename().string();
-			extract_archive(dest_dir, archive);
+			jobs.push_back({ path.string(), 0, dest_dir });
 		}
+		extract_archives(jobs, decompress, num_threads);
+	} else if(command == "pack") {
+		if(dest_path == "") {
+			std::cerr << "Must specify destination.\n";
+			return 0;
+		}
+		pack_archive(dest_path, src_path, compress, num_threads);
 	} else if(command == "scan") {
-		scan_for_archives(src_path);
+		scan_for_archives(src_path, num_threads);
 	} else {
 		std::cerr << "Invalid command.\n";
 	}
 }
 
-void extract_archive(std::string dest_dir, racpak& archive) {
-	std::size_t num_entries = archive.num_entries();
-	if(num_entries > 4096) {
-		std::cerr << "Error: More than 4096 entries in " << dest_dir << "!? It's probably not a valid racpack.\n";
-		return;
+// Extract the entries of all the archives at once, rather than one archive at
+// a time, so that small archives don't leave most of the threads idle. Each
+// entry is read with its own file handle so no stream state is shared between
+// threads.
+void extract_archives(std::vector<extract_job> jobs, bool decompress, std::size_t num_threads) {
+	struct extract_task {
+		const extract_job* job;
+		std::size_t index;
+		racpak_entry entry;
+	};
+	
+	std::vector<extract_task> tasks;
+	for(extract_job& job : jobs) {
+		try {
+			file_stream src_file(job.src_path);
+			racpak archive(&src_file, job.offset, src_file.size());
+			
+			std::size_t num_entries = archive.num_entries();
+			if(num_entries > 4096) {
+				std::cerr << "Error: More than 4096 entries in " << job.dest_dir << "!? It's probably not a valid racpack.\n";
+				continue;
+			}
+			std::vector<extract_task> job_tasks;
+			for(std::size_t i = 0; i < num_entries; i++) {
+				job_tasks.push_back({ &job, i, archive.entry(i) });
+			}
+			// Only queue up the entries once there's somewhere to put them.
+			fs::create_directories(job.dest_dir);
+			tasks.insert(tasks.end(), job_tasks.begin(), job_tasks.end());
+		} catch(std::exception& e) {
+			// e.g. an unreadable table of contents or a destination that
+			// can't be created, which shouldn't stop the other archives from
+			// being extracted.
+			std::cerr << "Error: Failed to prepare " << job.dest_dir << " for extraction: " << e.what() << "\n";
+		}
 	}
-	for(std::size_t i = 0; i < num_entries; i++) {
+	
+	std::mutex cerr_mutex;
+	parallel_for(tasks.size(), num_threads, [&](std::size_t i) {
+		const extract_task& task = tasks[i];
 		try {
-			auto entry = archive.entry(i);
-			fs::create_directories(dest_dir);
+			file_stream src(task.job->src_path);
+			std::size_t begin = task.job->offset + task.entry.offset;
+			std::size_t size = std::min(task.entry.size, src.size() - std::min(begin, src.size()));
+			
+			array_stream entry;
+			entry.buffer.resize(size);
+			src.seek(begin);
+			src.read_n(entry.data(), size);
 			
-			std::string dest_name = std::to_string(i) + "_" + int_to_hex(entry.offset);
-			file_stream dest(dest_dir + "/" + dest_name, std::ios::in | std::ios::out | std::ios::trunc);
+			std::string dest_name = std::to_string(task.index) + "_" + int_to_hex(task.entry.offset);
+			if(decompress && size >= sizeof(wad_header) && validate_wad(entry.data())) {
+				array_stream decompressed;
+				decompress_wad(decompressed, entry);
+				entry.buffer = std::move(decompressed.buffer);
+				dest_name += "_decompressed";
+			}
 			
-			stream* src = archive.open(entry);
-			src->seek(0);
-			stream::copy_n(dest, *src, src->size());
-		} catch(stream_error& e) {
-			std::cerr << "Error: Failed to extract item " << i << " for " << dest_dir << "\n";
+			file_stream dest(task.job->dest_dir + "/" + dest_name, std::ios::in | std::ios::out | std::ios::trunc);
+			dest.write_v(entry.buffer);
+		} catch(std::exception& e) {
+			// e.g. a corrupted WAD segment, which shouldn't stop the other
+			// entries from being extracted.
+			std::lock_guard<std::mutex> lock(cerr_mutex);
+			std::cerr << "Error: Failed to extract item " << task.index << " for " << task.job->dest_dir << ": " << e.what() << "\n";
 		}
-	}
+	});
 }
 
-// Scan an ISO file for racpak archives, where the table of contents is not
-// available. This is required to find assets on R&C1, UYA and DL game discs.
-void scan_for_archives(std::string src_path) {
-	file_stream src(src_path);
-	
-	std::vector<std::size_t> segments;
+// Build a racpak from a directory created by extract_archives. Files are
+// ordered by the index at the start of their name e.g. "12_1f000". Gaps in the
+// indices are written out as empty entries.
+void pack_archive(std::string dest_path, std::string src_dir, bool compress, std::size_t num_threads) {
+	struct pack_entry {
+		fs::path path;
+		std::size_t size = 0;
+		std::vector<char> compressed; // Only used if the entry was compressed here.
+		bool is_compressed = false;
+	};
 	
-	// First pass: Find all sector-aligned WAD segments and 2FIP textures.
-	for(std::size_t i = 0; i < src.size(); i += SECTOR_SIZE) {
-		char magic[4];
-		src.seek(i);
-		src.read_n(magic, 4);
-		
-		if(validate_wad(magic) || validate_fip(magic)) {
-			segments.push_back(i);
+	std::map<std::size_t, pack_entry> files;
+	for(auto iter = fs::directory_iterator(src_dir); iter != fs::directory_iterator(); iter++) {
+		if(!fs::is_regular_file(iter->path())) {
+			continue;
+		}
+		std::string name = iter->path().filename().string();
+		std::size_t index_size = name.find_first_not_of("0123456789");
+		if(index_size == 0 || index_size == std::string::npos || name[index_size] != '_') {
+			std::cerr << "Warning: Skipping " << name << " as its name doesn't start with an index.\n";
+			continue;
 		}
+		pack_entry& entry = files[std::stoul(name.substr(0, index_size))];
+		entry.path = iter->path();
+		entry.size = fs::file_size(iter->path());
 	}
 	
-	std::cout << "Found " << segments.size() << " segments.\n";
+	if(files.size() == 0) {
+		std::cerr << "Error: No entries to pack in " << src_dir << ".\n";
+		return;
+	}
 	
-	std::vector<std::size_t> valid_entries;
+	std::vector<pack_entry> entries(files.rbegin()->first + 1);
+	for(auto& [index, entry] : files) {
+		entries[index] = std::move(entry);
+	}
 	
-	// Second pass: Find racpaks.
-	for(std::size_t i = 0; i < src.size(); i += SECTOR_SIZE) {
-		
-		uint32_t num_entries = src.read<uint32_t>(i) / 2 - 1;
-		if(num_entries == 0 || num_entries > 4096) {
-			continue; // Invalid archive.
-		}
-		
-		// Only check the first 32 elements of an archive.
-		for(std::size_t j = 1; j <= 32; j++) {
-			std::size_t sector = src.read<uint32_t>(i + j * 2);
-			if(sector == 0) {
-				continue;
+	if(compress) {
+		parallel_for(entries.size(), num_threads, [&](std::size_t i) {
+			pack_entry& entry = entries[i];
+			if(entry.path.empty() || entry.size < 3) {
+				return;
 			}
-			std::size_t segment = i + sector * SECTOR_SIZE;
-			if(std::find(segments.begin(), segments.end(), segment) != segments.end()) {
-				std::cout << "Possible racpak archive at 0x" << std::hex << i << "\n";
-				break;
+			
+			array_stream src_array;
+			file_stream src(entry.path.string());
+			stream::copy_n(src_array, src, entry.size);
+			if(validate_wad(src_array.data())) {
+				return; // Already compressed.
 			}
+			
+			array_stream dest_array;
+			compress_wad(dest_array, src_array);
+			entry.compressed = std::move(dest_array.buffer);
+			entry.size = entry.compressed.size();
+			entry.is_compressed = true;
+		});
+	}
+	
+	// Lay out the entries so that each one starts on a sector boundary.
+	auto sectors_for = [](std::size_t bytes) {
+		return (bytes + SECTOR_SIZE - 1) / SECTOR_SIZE;
+	};
+	
+	std::size_t header_size = (entries.size() + 1) * 8;
+	std::vector<uint32_t> header(sectors_for(header_size) * SECTOR_SIZE / 4, 0);
+	header[0] = header_size;
+	uint32_t next_sector = sectors_for(header_size);
+	for(std::size_t i = 0; i < entries.size(); i++) {
+		if(entries[i].path.empty()) {
+			continue;
 		}
+		header[(i + 1) * 2] = next_sector;
+		header[(i + 1) * 2 + 1] = sectors_for(entries[i].size);
+		next_sector += sectors_for(entries[i].size);
+	}
+	
+	// Write the TOC and all the entries front to back.
+	file_stream dest(dest_path, std::ios::in | std::ios::out | std::ios::trunc);
+	dest.write_v(header);
+	std::vector<char> padding(SECTOR_SIZE, 0);
+	for(pack_entry& entry : entries) {
+		if(entry.path.empty()) {
+			continue;
+		}
+		if(entry.is_compressed) {
+			dest.write_v(entry.compressed);
+		} else {
+			file_stream src(entry.path.string());
+			stream::copy_n(dest, src, entry.size);
+		}
+		dest.write_n(padding.data(), sectors_for(entry.size) * SECTOR_SIZE - entry.size);
+	}
+	
+	std::cout << "Packed " << files.size() << " entries into " << dest_path << ".\n";
+}
+
+// Scan an ISO file for racpak archives, where the table of contents is not
+// available. This is required to find assets on R&C1, UYA and DL game discs.
+//
+// The scanning is done by the disc catalogue, which is cached, so scanning the
+// same image again is quick. See build_disc_catalogue for how racpaks are
+// told apart from data that only looks like a table of contents.
+void scan_for_archives(std::string src_path, std::size_t num_threads) {
+	disc_catalogue catalogue = open_disc_catalogue(src_path, num_threads);
+	
+	// The catalogue records WAD segments by what they contain.
+	std::size_t num_wads = std::count_if(catalogue.objects.begin(), catalogue.objects.end(),
+		[](const catalogue_object& object) { return object.compressed; });
+	std::cout << "Found " << num_wads << " WAD segments.\n";
+	
+	std::vector<const catalogue_object*> archives = catalogue.objects_of_type("racpak");
+	
+	for(const catalogue_object* archive : archives) {
+		std::cout << "Possible racpak archive at 0x" << std::hex << archive->offset
+		          << std::dec << " with " << archive->num_entries << " entries"
+		          << " (confidence " << std::fixed << std::setprecision(2) << archive->confidence << ")\n";
 	}
 }
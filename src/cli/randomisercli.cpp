@@ -73,8 +73,6 @@ int main(int argc, char** argv) {
 	MD5Final(hash, &ctx);
 	srand(*(unsigned int*) hash);
 	
-	auto game = gamedb_parse_file().at(game_id);
-	
 	// TODO: Change the wrench_project constructor so this mess isn't required.
 	std::map<std::string, std::string> game_paths
 		{ { game_id, iso_path } };
@@ -82,7 +80,7 @@ int main(int argc, char** argv) {
 	worker_logger log;
 	wrench_project project(game_paths, log, game_id);
 	
-	for(gamedb_file file_meta : game.files) {
+	for(gamedb_file file_meta : project.files()) {
 		proxy_stream file(&project.iso, file_meta.offset, file_meta.size);
 		
 		if(file_meta.type == +gamedb_file_type::LEVEL) {
@@ -16,21 +16,28 @@
 	along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <mutex>
 #include <sstream>
 #include <nlohmann/json.hpp>
 
+#include "../util.h"
 #include "../command_line.h"
 #include "../formats/wad.h"
 #include "../formats/fip.h"
+#include "../formats/classifier.h"
 
 # /*
 #	CLI tool to scan game files for known data segments.
 # */
 
+nlohmann::json describe_segment(const content_match& match, const char* data, std::size_t size);
+nlohmann::json describe_wad(const content_classifier& classifier, stream& src, const char* data, std::size_t offset, std::size_t bytes_needed);
+
 int main(int argc, char** argv) {
 	std::string src_path;
 	std::size_t alignment;
 	std::size_t initial_offset = 0;
+	std::size_t num_threads;
 
 	po::options_description desc("Scan a given file for game data segments");
 	desc.add_options()
@@ -39,7 +46,9 @@ int main(int argc, char** argv) {
 		("alignment,a", po::value<std::size_t>(&alignment)->default_value(0x100),
 			"A size in bytes that each segment in the target file should be aligned to.")
 		("initial-offset,i", po::value<std::size_t>(&initial_offset)->default_value(0),
-			"Where to start scanning. For example, if -a=0x100 and -i=0x10, offsets {0x110, 0x210, ...} will be checked.");
+			"Where to start scanning. For example, if -a=0x100 and -i=0x10, offsets {0x110, 0x210, ...} will be checked.")
+		("jobs,j", po::value<std::size_t>(&num_threads)->default_value(default_num_threads()),
+			"The maximum number of threads to use.");
 
 	po::positional_options_description pd;
 	pd.add("src", 1);
@@ -47,70 +56,114 @@ int main(int argc, char** argv) {
 	if(!parse_command_line_args(argc, argv, desc, pd)) {
 		return 0;
 	}
+	
+	if(alignment == 0) {
+		std::cerr << "Error: The alignment must be non-zero.\n";
+		return 1;
+	}
 
-	file_stream src(src_path);
-
-	std::size_t buffer_size = std::max(sizeof(wad_header), sizeof(fip_header));
-	std::size_t max_offset = src.size() - buffer_size - initial_offset;
-	for(std::size_t offset = initial_offset; offset < max_offset; offset += alignment) {
-
-		proxy_stream segment(&src, offset, src.size() - offset);
-		stream* segment_ptr = &segment;
-
-		nlohmann::json outer_output;
-		nlohmann::json output;
-		array_stream decompressed_segment;
+	// Racpak tables of contents and VIF chains are left out, since their
+	// signatures are only good enough to confirm something that's already
+	// expected to be there. Tested at every offset of a disc image they turn
+	// up all over the place.
+	content_classifier classifier = default_classifier({ "wad", "fip", "bmp" });
 
-		// If a segment is compressed, partially decompress it and then inspect
-		// the result. Otherwise just inspect the raw data.
-		char magic[4];
-		segment.seek(0);
-		segment.read_n(magic, 4);
-		if(validate_wad(magic)) {
-			auto wad = segment.read<wad_header>(0);
-			try {
-				// Decompress WAD.
-				array_stream dest_array;
-				array_stream src_array;
-				
-				uint32_t compressed_size = src.read<uint32_t>(0x3);
-				stream::copy_n(src_array, segment, compressed_size);
-				
-				decompress_wad_n(dest_array, src_array, buffer_size);
-				
-				stream::copy_n(decompressed_segment, dest_array, dest_array.size());
-				segment_ptr = &decompressed_segment;
-				
-				outer_output["type"] = "wad";
-				std::size_t total_size = wad.total_size;
-				outer_output["compressed_size"] = total_size;
-			} catch(stream_error& e) {
-				output["error"] = e.what();
+	std::size_t src_size = file_stream(src_path).size();
+	std::size_t buffer_size = std::max(sizeof(wad_header), 0x10 + sizeof(fip_header));
+	if(src_size < buffer_size + initial_offset) {
+		return 0;
+	}
+	std::size_t max_offset = src_size - buffer_size; // Inclusive.
+	
+	// Split the file up into shards of roughly 32 MiB, each of which is read in
+	// one go and scanned on its own thread. Results are written out in order as
+	// soon as all the shards before them are done.
+	std::size_t shard_span = std::max((std::size_t) 1, 0x2000000 / alignment) * alignment;
+	std::size_t num_shards = (max_offset - initial_offset) / shard_span + 1;
+	
+	std::vector<std::string> shard_output(num_shards);
+	std::vector<bool> shard_done(num_shards, false);
+	std::size_t next_shard_to_write = 0;
+	std::mutex output_mutex;
+	
+	parallel_for(num_shards, num_threads, [&](std::size_t shard) {
+		std::size_t shard_begin = initial_offset + shard * shard_span;
+		std::size_t shard_end = std::min(shard_begin + shard_span, max_offset + 1);
+		
+		file_stream src(src_path);
+		// Read buffer_size bytes past the last offset in the shard, which is
+		// enough for every signature and for describe_segment.
+		std::vector<char> buffer(shard_end - 1 + buffer_size - shard_begin);
+		src.seek(shard_begin);
+		src.read_n(buffer.data(), buffer.size());
+		
+		std::string output;
+		for(const content_match& match : classifier.classify(buffer.data(), buffer.size(), alignment, shard_end - shard_begin)) {
+			const char* data = buffer.data() + match.offset;
+			std::size_t size = buffer.size() - match.offset;
+			nlohmann::json output_line;
+			if(match.is("wad")) {
+				output_line = describe_wad(classifier, src, data, shard_begin + match.offset, buffer_size);
+			} else {
+				output_line = describe_segment(match, data, size);
 			}
-		}
-
-		segment_ptr->seek(0);
-		segment_ptr->read_n(magic, 4);
-		if(validate_fip(magic)) {
-			auto fip = segment_ptr->read<fip_header>(0);
-			output["type"] = "fip";
-			int width = fip.width;
-			output["width"] = width;
-			int height = fip.height;
-			output["height"] = height;
-			output["size"] = sizeof(fip_header) + width * height;
+			output_line["offset"] = shard_begin + match.offset;
+			output += output_line.dump() + "\n";
 		}
 		
-		if(!outer_output.empty()) {
-			outer_output["offset"] = offset;
-			outer_output["compressed_data"] = output;
-			std::cout << outer_output.dump() << std::endl;
-			continue;
+		std::lock_guard<std::mutex> lock(output_mutex);
+		shard_output[shard] = std::move(output);
+		shard_done[shard] = true;
+		while(next_shard_to_write < num_shards && shard_done[next_shard_to_write]) {
+			std::string& text = shard_output[next_shard_to_write++];
+			std::cout.write(text.data(), text.size());
+			text = std::string();
 		}
+		std::cout.flush();
+	});
+}
 
-		if(!output.empty()) {
-			output["offset"] = offset;
-			std::cout << output.dump() << std::endl;
-		}
+// Describe an uncompressed segment. size is the number of bytes available.
+nlohmann::json describe_segment(const content_match& match, const char* data, std::size_t size) {
+	nlohmann::json output;
+	output["type"] = match.signature->name;
+	if(match.is("fip") && size >= sizeof(fip_header)) {
+		fip_header fip;
+		std::memcpy(&fip, data, sizeof(fip_header));
+		int width = fip.width;
+		output["width"] = width;
+		int height = fip.height;
+		output["height"] = height;
+		output["size"] = sizeof(fip_header) + width * height;
+	}
+	return output;
+}
+
+// Partially decompress a WAD segment and then inspect the result.
+nlohmann::json describe_wad(const content_classifier& classifier, stream& src, const char* data, std::size_t offset, std::size_t bytes_needed) {
+	wad_header wad;
+	std::memcpy(&wad, data, sizeof(wad_header));
+	
+	nlohmann::json output;
+	output["type"] = "wad";
+	std::size_t total_size = wad.total_size;
+	output["compressed_size"] = total_size;
+	output["compressed_data"] = nullptr;
+	
+	array_stream decompressed;
+	try {
+		decompress_wad_prefix(decompressed, src, offset, bytes_needed);
+	} catch(stream_error& e) {
+		output["compressed_data"]["error"] = e.what();
+		return output;
+	}
+	
+	for(const content_match& match : classifier.classify_at(decompressed.data(), decompressed.size())) {
+		nlohmann::json inner = describe_segment(match, decompressed.data() + match.offset, decompressed.size() - match.offset);
+		inner["offset"] = match.offset;
+		output["compressed_data"] = inner;
+		break;
 	}
+	
+	return output;
 }
@@ -0,0 +1,111 @@
+/*
+	wrench - A set of modding tools for the Ratchet & Clank PS2 games.
+	Copyright (C) 2019-2020 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+
+#include "../util.h"
+#include "../project.h"
+#include "../command_line.h"
+#include "../texture_export.h"
+
+# /*
+#	CLI tool to export every texture in a game to BMP files, for when the
+#	texture browser's export button won't cut it, and to import a directory
+#	of edited BMP files back into a new project.
+# */
+
+int main(int argc, char** argv) {
+	std::string command;
+	std::string iso_path;
+	std::string game_id;
+	std::string dir;
+	std::string project_path;
+	bool dither = false;
+	std::size_t num_threads;
+	
+	po::options_description desc("Export or import all the textures from a game");
+	desc.add_options()
+		("command,c", po::value<std::string>(&command)->required(),
+			"The operation to perform. Possible values are: export, import.")
+		("iso,i", po::value<std::string>(&iso_path)->required(),
+			"The game ISO to use.")
+		("gameid,g", po::value<std::string>(&game_id)->required(),
+			"The game ID (e.g. 'SCES_516.07')")
+		("dir,d", po::value<std::string>(&dir)->required(),
+			"The directory to write the BMP files to, or read them from.")
+		("project,p", po::value<std::string>(&project_path),
+			"The path of the new project to create. Only applicable in import mode.")
+		("dither", po::bool_switch(&dither),
+			"Dither truecolour images when reducing them to 256 colours. Only applicable in import mode.")
+		("jobs,j", po::value<std::size_t>(&num_threads)->default_value(default_num_threads()),
+			"The maximum number of threads to use.");
+
+	po::positional_options_description pd;
+	pd.add("command", 1);
+	pd.add("iso", 1);
+	pd.add("gameid", 1);
+	pd.add("dir", 1);
+
+	if(!parse_command_line_args(argc, argv, desc, pd)) {
+		return 0;
+	}
+	
+	if(command != "export" && command != "import") {
+		std::cerr << "Invalid command.\n";
+		return 1;
+	}
+	
+	if(command == "import" && project_path == "") {
+		std::cerr << "Must specify a project path.\n";
+		return 1;
+	}
+	
+	// TODO: Change the wrench_project constructor so this mess isn't required.
+	std::map<std::string, std::string> game_paths
+		{ { game_id, iso_path } };
+	
+	worker_logger log;
+	wrench_project project(game_paths, log, game_id);
+	
+	for(const gamedb_file& file : project.files()) {
+		try {
+			project.open_file(file);
+		} catch(stream_error& e) {
+			std::cerr << "Warning: Failed to open " << file.name << ": " << e.what() << "\n";
+		}
+	}
+	
+	if(command == "export") {
+		texture_export_result result =
+			export_texture_lists(project.texture_lists(), dir, num_threads);
+		
+		std::cout << "Wrote " << result.written << " textures, "
+		          << result.up_to_date << " already up to date, "
+		          << result.failed << " failed.\n";
+		return result.failed == 0 ? 0 : 1;
+	} else {
+		texture_import_result result =
+			import_texture_lists(project.texture_lists(), dir, project.iso, dither, num_threads);
+		project.save_to(project_path);
+		
+		std::cout << "Imported " << result.imported << " textures, "
+		          << result.unchanged << " unchanged, "
+		          << result.failed << " failed.\n";
+		return result.failed == 0 ? 0 : 1;
+	}
+}
@@ -21,87 +21,139 @@
 #	a different palette.
 # */
 
+#include <fstream>
 #include <iostream>
+#include <optional>
+#include <boost/filesystem.hpp>
 
+#include "../util.h"
+#include "../game_db.h"
+#include "../texture_index.h"
+#include "../disc_catalogue.h"
 #include "../command_line.h"
 #include "../formats/bmp.h"
 #include "../formats/fip.h"
 
-std::vector<std::size_t> hash_pixel_data(char* texture, std::size_t num_bytes);
+namespace fs = boost::filesystem;
+
+struct target_texture {
+	std::string path;
+	std::size_t width;
+	std::size_t height;
+	uint64_t hash;
+};
+
+std::vector<std::string> expand_target_paths(std::vector<std::string> paths);
+std::optional<target_texture> load_target(std::string path);
 
 int main(int argc, char** argv) {
 	std::string iso_path;
-	std::string target_path;
+	std::vector<std::string> target_paths;
+	std::string game_id;
 	
-	po::options_description desc("Scan a game data segment for a given indexed BMP file, even if said file has a different palette. For example, you could dump a texture using PCSX2, convert it to an indexed BMP (with 256 colours) using the GNU Image Manipulation Program, and then feed it into this program to find where it is stored on disc, using the command \"./bin/texturefinder game.iso texture.bmp\"");
+	po::options_description desc("Scan a game data segment for one or more indexed BMP files, even if said files have a different palette. For example, you could dump a texture using PCSX2, convert it to an indexed BMP (with 256 colours) using the GNU Image Manipulation Program, and then feed it into this program to find where it is stored on disc, using the command \"./bin/texturefinder game.iso texture.bmp\"");
 	desc.add_options()
 		("iso,i", po::value<std::string>(&iso_path)->required(),
 			"The data segment to scan.")
-		("target,t", po::value<std::string>(&target_path)->required(),
-			"The texture to scan for.");
+		("target,t", po::value<std::vector<std::string>>(&target_paths)->required()->multitoken(),
+			"The textures to scan for. Each of these can be a BMP file, a directory containing BMP files, or a text file listing paths to BMP files, one per line.")
+		("game,g", po::value<std::string>(&game_id)->default_value(""),
+			"The game ID (e.g. 'SCES_516.07'). If specified, level textures will also be searched.");
 
 	po::positional_options_description pd;
 	pd.add("iso", 1);
-	pd.add("target", 1);
+	pd.add("target", -1);
 
 	if(!parse_command_line_args(argc, argv, desc, pd)) {
 		return 0;
 	}
 	
-	file_stream iso(iso_path);
-	file_stream target(target_path);
-	
-	// Hash the target texture.
-	auto bmp_header = target.read<bmp_file_header>(0);
-	auto info_header = target.read<bmp_info_header>();
-	if(!validate_bmp(bmp_header)) {
-		std::cerr << "Error: Input texture must be a valid indexed BMP file.\n";
+	if(game_id != "" && gamedb_parse_file().count(game_id) == 0) {
+		std::cerr << "Error: Game ID not found in gamedb.txt.\n";
 		return 1;
 	}
-	uint32_t row_size = ((info_header.bits_per_pixel * info_header.width + 31) / 32) * 4;
-	std::vector<char> pixels(info_header.width * info_header.height);
-	target.seek(bmp_header.pixel_data.value);	
-	for(int y = info_header.height - 1; y >= 0; y--) {
-		target.read_n(pixels.data() + y * row_size, row_size);
-	}
-	std::vector<std::size_t> target_hash = hash_pixel_data(pixels.data(), 256);
 	
-	// Iterate over all uncompressed 2FIP textures.
-	for(std::size_t i = 0; i < iso.size(); i += 0x800) {
-		char magic[0x14];
-		iso.seek(i);
-		iso.read_n(magic, 0x14);
-		
-		std::optional<std::size_t> fip_offset;
-		if(validate_fip(magic)) {
-			fip_offset = 0;
-		} else if(validate_fip(magic + 0x10)) {
-			fip_offset = 0x10;
+	// Hash all the targets up front.
+	std::vector<target_texture> targets;
+	for(std::string& path : expand_target_paths(target_paths)) {
+		if(std::optional<target_texture> target = load_target(path)) {
+			targets.emplace_back(*target);
 		}
-		
-		if(fip_offset) {
-			// The sector contains a 2FIP texture.
-			std::size_t test_offset = i + *fip_offset;
-			char test_pixels[256];
-			iso.seek(test_offset + sizeof(fip_header));
-			iso.read_n(test_pixels, 256);
-			
-			// We cannot just compare each byte, since the palette indices
-			// may be different.
-			std::vector<std::size_t> test_hash = hash_pixel_data(test_pixels, 256);
-			if(test_hash == target_hash) {
-				std::cout << "Possible matching texture found at 0x" << std::hex << test_offset << "\n";
+	}
+	if(targets.size() == 0) {
+		std::cerr << "Error: No valid targets.\n";
+		return 1;
+	}
+	
+	// The catalogue and index are only built the first time a given file is
+	// scanned, after which each target is just a lookup.
+	disc_catalogue catalogue = open_disc_catalogue(iso_path, default_num_threads());
+	texture_index index = open_texture_index(iso_path, catalogue, game_id, default_num_threads());
+	
+	for(target_texture& target : targets) {
+		std::size_t num_matches = 0;
+		std::cout << target.path << ":\n";
+		for(const texture_index_entry* entry : index.find(target.hash)) {
+			if(entry->width != target.width || entry->height != target.height) {
+				continue;
+			}
+			num_matches++;
+			if(entry->compressed) {
+				std::cout << "\tPossible matching texture (" << entry->source << ") found in WAD segment at 0x"
+				          << std::hex << entry->offset << " (pixel data at 0x" << entry->pixel_offset
+				          << " after decompression)\n" << std::dec;
+			} else {
+				std::cout << "\tPossible matching texture (" << entry->source << ") found at 0x"
+				          << std::hex << entry->offset + entry->pixel_offset - sizeof(fip_header) << "\n" << std::dec;
 			}
 		}
+		if(num_matches == 0) {
+			std::cout << "\tNo matches found.\n";
+		}
 	}
 }
 
-std::vector<std::size_t> hash_pixel_data(char* texture, std::size_t num_bytes) {
-	std::vector<std::size_t> offsets;
-	for(std::size_t i = 1; i < num_bytes; i++) {
-		if(texture[i] != texture[i - 1]) {
-			offsets.push_back(i);
+// Replace directories with the BMP files they contain, and text files with
+// the paths listed in them.
+std::vector<std::string> expand_target_paths(std::vector<std::string> paths) {
+	std::vector<std::string> result;
+	for(std::string& path : paths) {
+		if(fs::is_directory(path)) {
+			std::vector<std::string> bmps;
+			for(auto iter = fs::directory_iterator(path); iter != fs::directory_iterator(); iter++) {
+				std::string extension = iter->path().extension().string();
+				std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+				if(fs::is_regular_file(iter->path()) && extension == ".bmp") {
+					bmps.push_back(iter->path().string());
+				}
+			}
+			std::sort(bmps.begin(), bmps.end());
+			result.insert(result.end(), bmps.begin(), bmps.end());
+		} else if(fs::path(path).extension() == ".txt") {
+			std::ifstream list(path);
+			std::string line;
+			while(std::getline(list, line)) {
+				if(line != "") {
+					result.push_back(line);
+				}
+			}
+		} else {
+			result.push_back(path);
 		}
 	}
-	return offsets;
+	return result;
+}
+
+// Truecolour targets are quantised the same way as when they're imported.
+std::optional<target_texture> load_target(std::string path) {
+	try {
+		file_stream target(path);
+		bmp_indexed_image image = read_indexed_bmp(target);
+		std::size_t width = image.width;
+		std::size_t height = image.height;
+		return target_texture { path, width, height, palette_invariant_hash(image.pixels.data(), width, height) };
+	} catch(stream_error& e) {
+		std::cerr << "Error: Failed to read " << path << ": " << e.what() << "\n";
+		return {};
+	}
 }
@@ -0,0 +1,246 @@
+/*
+	wrench - A set of modding tools for the Ratchet & Clank PS2 games.
+	Copyright (C) 2019-2020 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <mutex>
+#include <atomic>
+#include <iostream>
+
+#include "../util.h"
+#include "../command_line.h"
+#include "../formats/vif.h"
+
+# /*
+# 	CLI tool to check vif_code::parse and vif_code::packet_size against a
+# 	straightforward switch-based decoder, for every possible VIF code.
+# */
+
+static const std::size_t MAX_REPORTED_MISMATCHES = 16;
+
+std::optional<vif_code> reference_parse(uint32_t val);
+std::size_t reference_packet_size(const vif_code& code);
+bool codes_equal(const vif_code& lhs, const vif_code& rhs);
+
+int main(int argc, char** argv) {
+	std::size_t num_threads;
+
+	po::options_description desc("Check the VIF code decoder against a reference implementation for every possible code");
+	desc.add_options()
+		("jobs,j", po::value<std::size_t>(&num_threads)->default_value(default_num_threads()),
+			"The maximum number of threads to use.");
+
+	po::positional_options_description pd;
+
+	if(!parse_command_line_args(argc, argv, desc, pd)) {
+		return 0;
+	}
+
+	std::atomic<std::size_t> num_valid(0);
+	std::atomic<std::size_t> num_mismatches(0);
+	std::mutex cerr_mutex;
+
+	// One job per command byte, each covering every num and immediate.
+	parallel_for(256, num_threads, [&](std::size_t command_byte) {
+		std::size_t valid = 0;
+		for(uint32_t low = 0; low < (1 << 24); low++) {
+			uint32_t val = (static_cast<uint32_t>(command_byte) << 24) | low;
+			std::optional<vif_code> expected = reference_parse(val);
+			std::optional<vif_code> actual = vif_code::parse(val);
+
+			std::string mismatch;
+			if(expected.has_value() != actual.has_value()) {
+				mismatch = expected ? "rejected" : "accepted";
+			} else if(expected) {
+				valid++;
+				if(!codes_equal(*expected, *actual)) {
+					mismatch = "decoded differently";
+				} else if(reference_packet_size(*expected) != actual->packet_size()) {
+					mismatch = "packet size " + std::to_string(actual->packet_size()) +
+						", expected " + std::to_string(reference_packet_size(*expected));
+				}
+			}
+
+			if(mismatch != "" && num_mismatches++ < MAX_REPORTED_MISMATCHES) {
+				std::lock_guard<std::mutex> lock(cerr_mutex);
+				std::cerr << "Mismatch: 0x" << std::hex << val << std::dec << " " << mismatch << "\n";
+			}
+		}
+		num_valid += valid;
+	});
+
+	std::cout << "Checked 4294967296 codes, " << num_valid << " valid, "
+		<< num_mismatches << " mismatches.\n";
+	return num_mismatches == 0 ? 0 : 1;
+}
+
+std::optional<vif_code> reference_parse(uint32_t val) {
+	vif_code code;
+	code.interrupt = bit_range(val, 31, 31);
+	code.cmd       = static_cast<vif_cmd>(bit_range(val, 24, 30));
+	code.num       = bit_range(val, 16, 23);
+	code.num = code.num ? code.num : 256;
+	
+	switch(code.cmd) {
+		case vif_cmd::NOP:
+			break;
+		case vif_cmd::STCYCL:
+			code.stcycl.wl = bit_range(val, 8, 15);
+			code.stcycl.cl = bit_range(val, 0, 7);
+			break;
+		case vif_cmd::OFFSET:
+			code.offset.offset = bit_range(val, 0, 9);
+			break;
+		case vif_cmd::BASE:
+			code.base.base = bit_range(val, 0, 9);
+			break;
+		case vif_cmd::ITOP:
+			code.itop.addr = bit_range(val, 0, 9);
+			break;
+		case vif_cmd::STMOD:
+			code.stmod.mode = bit_range(val, 0, 1);
+			break;
+		case vif_cmd::MSKPATH3:
+			code.mskpath3.mask = bit_range(val, 15, 15);
+			break;
+		case vif_cmd::MARK:
+			code.mark.mark = bit_range(val, 0, 15);
+			break;
+		case vif_cmd::FLUSHE:
+		case vif_cmd::FLUSH:
+		case vif_cmd::FLUSHA:
+			break;
+		case vif_cmd::MSCAL:
+			code.mscal.execaddr = bit_range(val, 0, 15);
+			break;
+		case vif_cmd::MSCNT:
+			break;
+		case vif_cmd::MSCALF:
+			code.mscalf.execaddr = bit_range(val, 0, 15);
+			break;
+		case vif_cmd::STMASK:
+		case vif_cmd::STROW:
+		case vif_cmd::STCOL:
+			break;
+		case vif_cmd::MPG:
+			code.mpg.loadaddr = bit_range(val, 0, 15);
+			break;
+		case vif_cmd::DIRECT:
+			code.direct.size = bit_range(val, 0, 15);
+			code.direct.size = code.direct.size ? code.direct.size : 65536;
+			break;
+		case vif_cmd::DIRECTHL:
+			code.directhl.size = bit_range(val, 0, 15);
+			code.directhl.size = code.directhl.size ? code.directhl.size : 65536;
+			break;
+		default:
+			if(!code.is_unpack()) {
+				return {};
+			}
+			code.unpack.vn = bit_range(val, 26, 27);
+			code.unpack.vl = bit_range(val, 24, 25);
+			code.unpack.vnvl = vif_vnvl::_from_integral(bit_range(val, 24, 27));
+			code.unpack.flg  = vif_flg::_from_integral(bit_range(val, 15, 15));
+			code.unpack.usn  = vif_usn::_from_integral(bit_range(val, 14, 14));
+			code.unpack.addr = bit_range(val, 0, 9);
+	}
+	
+	return code;
+}
+
+std::size_t reference_packet_size(const vif_code& code) {
+	std::size_t result = 0;
+	switch(code.cmd) {
+		case vif_cmd::NOP:
+		case vif_cmd::STCYCL:
+		case vif_cmd::OFFSET:
+		case vif_cmd::BASE:
+		case vif_cmd::ITOP:
+		case vif_cmd::STMOD:
+		case vif_cmd::MSKPATH3:
+		case vif_cmd::MARK:
+		case vif_cmd::FLUSHE:
+		case vif_cmd::FLUSH:
+		case vif_cmd::FLUSHA:
+		case vif_cmd::MSCAL:
+		case vif_cmd::MSCNT:
+		case vif_cmd::MSCALF:
+			result = 1;
+			break;
+		case vif_cmd::STMASK:
+			result = 2;
+			break;
+		case vif_cmd::STROW:
+		case vif_cmd::STCOL:
+			result = 5;
+			break;
+		case vif_cmd::MPG:
+			result = 1 + code.num * 2;
+			break;
+		case vif_cmd::DIRECT:
+			result = 1 + code.direct.size * 4;
+			break;
+		case vif_cmd::DIRECTHL:
+			result = 1 + code.directhl.size * 4;
+			break;
+		default:
+			if(code.is_unpack()) {
+				// This is what PCSX2 does when wl <= cl.
+				// Assume wl = cl = 4.
+				int gsize = ((32 >> code.unpack.vl) * (code.unpack.vn + 1)) / 8;
+				result = 1 + (code.num * gsize) / 4;
+			}
+	}
+	return result * 4;
+}
+
+// Only compares the fields the reference decoder fills in.
+bool codes_equal(const vif_code& lhs, const vif_code& rhs) {
+	if(lhs.interrupt != rhs.interrupt || lhs.cmd != rhs.cmd || lhs.num != rhs.num) {
+		return false;
+	}
+	switch(lhs.cmd) {
+		case vif_cmd::NOP:
+		case vif_cmd::FLUSHE:
+		case vif_cmd::FLUSH:
+		case vif_cmd::FLUSHA:
+		case vif_cmd::MSCNT:
+		case vif_cmd::STMASK:
+		case vif_cmd::STROW:
+		case vif_cmd::STCOL:
+			return true;
+		case vif_cmd::STCYCL:   return lhs.stcycl.wl == rhs.stcycl.wl && lhs.stcycl.cl == rhs.stcycl.cl;
+		case vif_cmd::OFFSET:   return lhs.offset.offset == rhs.offset.offset;
+		case vif_cmd::BASE:     return lhs.base.base == rhs.base.base;
+		case vif_cmd::ITOP:     return lhs.itop.addr == rhs.itop.addr;
+		case vif_cmd::STMOD:    return lhs.stmod.mode == rhs.stmod.mode;
+		case vif_cmd::MSKPATH3: return lhs.mskpath3.mask == rhs.mskpath3.mask;
+		case vif_cmd::MARK:     return lhs.mark.mark == rhs.mark.mark;
+		case vif_cmd::MSCAL:    return lhs.mscal.execaddr == rhs.mscal.execaddr;
+		case vif_cmd::MSCALF:   return lhs.mscalf.execaddr == rhs.mscalf.execaddr;
+		case vif_cmd::MPG:      return lhs.mpg.loadaddr == rhs.mpg.loadaddr;
+		case vif_cmd::DIRECT:   return lhs.direct.size == rhs.direct.size;
+		case vif_cmd::DIRECTHL: return lhs.directhl.size == rhs.directhl.size;
+		default:
+			return
+				lhs.unpack.vn == rhs.unpack.vn &&
+				lhs.unpack.vl == rhs.unpack.vl &&
+				lhs.unpack.vnvl == rhs.unpack.vnvl &&
+				lhs.unpack.flg == rhs.unpack.flg &&
+				lhs.unpack.usn == rhs.unpack.usn &&
+				lhs.unpack.addr == rhs.unpack.addr;
+	}
+}
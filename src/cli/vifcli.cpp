@@ -16,44 +16,237 @@
 	along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
-# /*
-# 	CLI tool to parse VIF chains.
-# */
-
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <fstream>
+#include <sstream>
 #include <iostream>
 
 #include "../util.h"
 #include "../command_line.h"
 #include "../formats/vif.h"
 
+# /*
+# 	CLI tool to parse VIF chains.
+# */
+
+struct chain_location {
+	std::string path;
+	std::size_t offset;
+	std::size_t qwc;
+};
+
+// Counts of everything seen while parsing some chains, for format research.
+struct chain_stats {
+	std::size_t num_chains = 0;
+	std::size_t num_packets = 0;
+	std::map<std::string, std::size_t> commands;
+	std::map<std::string, std::size_t> unpack_formats;
+	std::map<std::string, std::size_t> errors;
+
+	void add(const std::vector<vif_packet>& chain);
+	void merge(const chain_stats& other);
+};
+
+std::vector<std::pair<std::size_t, std::size_t>> read_offsets_file(std::istream& file, std::size_t default_qwc);
+void print_chain(std::ostream& output, const std::vector<vif_packet>& chain);
+void print_stats(const chain_stats& stats);
+
 int main(int argc, char** argv) {
-	std::string src_path;
-	std::string offset_str;
+	std::vector<std::string> src_paths;
+	std::vector<std::string> offset_strs;
+	std::string offsets_path;
+	std::string qwc_str;
+	bool stats_mode = false;
+	std::size_t num_threads;
 
 	po::options_description desc("Parse PS2 VIF chains until an invalid VIF code is encountered");
 	desc.add_options()
-		("src,s",    po::value<std::string>(&src_path)->required(),
-			"The input file.")
-		("offset,o", po::value<std::string>(&offset_str)->default_value("0"),
-			"The offset in the input file where the VIF chain begins.");
+		("src,s",          po::value<std::vector<std::string>>(&src_paths)->required()->multitoken(),
+			"The input files. Directories and glob patterns are expanded to the files they contain.")
+		("offset,o",       po::value<std::vector<std::string>>(&offset_strs)->default_value({ "0" }, "0")->multitoken(),
+			"The offsets in each input file where VIF chains begin.")
+		("offsets-file,f", po::value<std::string>(&offsets_path),
+			"A text file listing offsets to use instead, one per line, each optionally followed by a qwc (e.g. dumped from a model table).")
+		("qwc,q",          po::value<std::string>(&qwc_str),
+			"The maximum size of each chain in quadwords. If not specified, chains are parsed until an invalid VIF code is encountered.")
+		("stats",          po::bool_switch(&stats_mode),
+			"Print counts of each command and unpack format across all the chains instead of the chains themselves.")
+		("jobs,j",         po::value<std::size_t>(&num_threads)->default_value(default_num_threads()),
+			"The maximum number of threads to use.");
 
 	po::positional_options_description pd;
-	pd.add("src", 1);
+	pd.add("src", -1);
 
 	if(!parse_command_line_args(argc, argv, desc, pd)) {
 		return 0;
 	}
 	
-	std::size_t offset = parse_number(offset_str);
+	std::size_t default_qwc = qwc_str != "" ? parse_number(qwc_str) : SIZE_MAX;
+	std::vector<std::pair<std::size_t, std::size_t>> offsets;
+	if(offsets_path != "") {
+		std::ifstream offsets_file(offsets_path);
+		if(!offsets_file) {
+			std::cerr << "Error: Failed to open offsets file.\n";
+			return 1;
+		}
+		offsets = read_offsets_file(offsets_file, default_qwc);
+	} else {
+		for(std::string& offset_str : offset_strs) {
+			offsets.emplace_back(parse_number(offset_str), default_qwc);
+		}
+	}
+	
+	std::vector<chain_location> chains;
+	for(std::string& src_path : src_paths) {
+		for(std::string& path : find_input_files(src_path)) {
+			for(auto& [offset, qwc] : offsets) {
+				chains.push_back({ path, offset, qwc });
+			}
+		}
+	}
+	if(chains.size() == 0) {
+		std::cerr << "No input files found.\n";
+		return 1;
+	}
+	
+	// Only label the chains if there's more than one.
+	bool print_headers = chains.size() > 1;
+	
+	std::mutex cerr_mutex;
+	std::atomic<std::size_t> num_failed(0);
+	auto process_chain = [&](const chain_location& location, std::ostream& output, chain_stats* stats) {
+		try {
+			file_stream src(location.path);
+			std::vector<vif_packet> chain = parse_vif_chain(&src, location.offset, location.qwc);
+			if(stats != nullptr) {
+				stats->add(chain);
+			} else {
+				if(print_headers) {
+					output << location.path << " 0x" << std::hex << location.offset << ":\n";
+				}
+				print_chain(output, chain);
+			}
+		} catch(std::exception& e) {
+			// e.g. a stream_error, or a std::bad_alloc for a huge qwc. Only
+			// this chain is lost, not the whole batch.
+			num_failed++;
+			std::lock_guard<std::mutex> lock(cerr_mutex);
+			std::cerr << "Error: Failed to parse chain at 0x" << std::hex << location.offset
+				<< " in " << location.path << ": " << e.what() << "\n";
+		}
+	};
+	
+	if(!stats_mode && (num_threads <= 1 || chains.size() == 1)) {
+		// Avoid buffering up whole chains when nothing is gained from it.
+		for(const chain_location& location : chains) {
+			process_chain(location, std::cout, nullptr);
+		}
+		std::cout.flush();
+		return num_failed == 0 ? 0 : 1;
+	}
+	
+	// Each chain is parsed on its own thread with its own stream. Output is
+	// written in order as soon as all the chains before it are done.
+	std::vector<chain_stats> stats(stats_mode ? chains.size() : 0);
+	std::vector<std::string> chain_output(chains.size());
+	std::vector<bool> chain_done(chains.size(), false);
+	std::size_t next_chain_to_write = 0;
+	std::mutex output_mutex;
+	
+	parallel_for(chains.size(), num_threads, [&](std::size_t i) {
+		std::ostringstream output;
+		process_chain(chains[i], output, stats_mode ? &stats[i] : nullptr);
+		
+		std::lock_guard<std::mutex> lock(output_mutex);
+		chain_output[i] = output.str();
+		chain_done[i] = true;
+		while(next_chain_to_write < chains.size() && chain_done[next_chain_to_write]) {
+			std::string& text = chain_output[next_chain_to_write++];
+			std::cout.write(text.data(), text.size());
+			text = std::string();
+		}
+	});
+	std::cout.flush();
+	
+	if(stats_mode) {
+		chain_stats total;
+		for(chain_stats& chain : stats) {
+			total.merge(chain);
+		}
+		print_stats(total);
+	}
+	
+	return num_failed == 0 ? 0 : 1;
+}
 
-	file_stream src(src_path);
-	std::vector<vif_packet> chain = parse_vif_chain(&src, offset, SIZE_MAX);
-	for(vif_packet& packet : chain) {
+void print_chain(std::ostream& output, const std::vector<vif_packet>& chain) {
+	for(const vif_packet& packet : chain) {
 		if(packet.error != "") {
-			std::cout << packet.error << std::endl;
+			output << packet.error << "\n";
 			break;
 		}
-		
-		std::cout << std::hex << packet.address << " " << packet.code.to_string() << std::endl;
+		output << std::hex << packet.address << " " << packet.code.to_string() << "\n";
 	}
 }
+
+void chain_stats::add(const std::vector<vif_packet>& chain) {
+	num_chains++;
+	for(const vif_packet& packet : chain) {
+		if(packet.error != "") {
+			errors[packet.error]++;
+			if(packet.data.size() == 0) {
+				continue; // Not a valid packet.
+			}
+		}
+		num_packets++;
+		commands[vif_cmd_name(packet.code.cmd)]++;
+		if(packet.code.is_unpack()) {
+			std::string format = packet.code.unpack.vnvl._to_string();
+			if(static_cast<int>(packet.code.cmd) & 0b10000) {
+				format += " (masked)";
+			}
+			unpack_formats[format]++;
+		}
+	}
+}
+
+void chain_stats::merge(const chain_stats& other) {
+	num_chains += other.num_chains;
+	num_packets += other.num_packets;
+	for(auto& [name, count] : other.commands) commands[name] += count;
+	for(auto& [name, count] : other.unpack_formats) unpack_formats[name] += count;
+	for(auto& [name, count] : other.errors) errors[name] += count;
+}
+
+// Lines starting with # are ignored.
+std::vector<std::pair<std::size_t, std::size_t>> read_offsets_file(std::istream& file, std::size_t default_qwc) {
+	std::vector<std::pair<std::size_t, std::size_t>> result;
+	std::string line;
+	while(std::getline(file, line)) {
+		std::istringstream words(line);
+		std::string offset_str, qwc_str;
+		if(!(words >> offset_str) || offset_str[0] == '#') {
+			continue;
+		}
+		words >> qwc_str;
+		result.emplace_back(parse_number(offset_str), qwc_str != "" ? parse_number(qwc_str) : default_qwc);
+	}
+	return result;
+}
+
+void print_stats(const chain_stats& stats) {
+	auto print_counts = [](const char* title, const std::map<std::string, std::size_t>& counts) {
+		std::cout << title << ":\n";
+		for(auto& [name, count] : counts) {
+			std::cout << "\t" << name << "\t" << count << "\n";
+		}
+	};
+	std::cout << std::dec;
+	std::cout << "Chains: " << stats.num_chains << "\n";
+	std::cout << "Packets: " << stats.num_packets << "\n";
+	print_counts("Commands", stats.commands);
+	print_counts("Unpack formats", stats.unpack_formats);
+	print_counts("Errors", stats.errors);
+}
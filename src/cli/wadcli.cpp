@@ -32,8 +32,8 @@ int main(int argc, char** argv) {
 	return run_cli_converter(argc, argv,
 		"Decompress WAD segments",
 		{
-			{ "decompress", copy_and_decompress },
-			{ "compress", copy_and_compress }
+			{ "decompress", { copy_and_decompress, ".bin" } },
+			{ "compress", { copy_and_compress, ".wad" } }
 		});
 }
 
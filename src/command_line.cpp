@@ -18,11 +18,18 @@
 
 #include "command_line.h"
 
+#include <atomic>
+#include <mutex>
+#include <algorithm>
 #include <sstream>
 #include <iostream>
+#include <boost/filesystem.hpp>
 
+#include "util.h"
 #include "config.h"
 
+namespace fs = boost::filesystem;
+
 bool parse_command_line_args(
 	int argc, char** argv,
 	po::options_description desc,
@@ -60,15 +67,84 @@ bool parse_command_line_args(
 	return true;
 }
 
+struct cli_job {
+	fs::path src;
+	fs::path dest;
+};
+
+// Supports * and ? only.
+static bool glob_match(const char* pattern, const char* name) {
+	if(*pattern == '\0') {
+		return *name == '\0';
+	}
+	if(*pattern == '*') {
+		return glob_match(pattern + 1, name) || (*name != '\0' && glob_match(pattern, name + 1));
+	}
+	if(*name != '\0' && (*pattern == '?' || *pattern == *name)) {
+		return glob_match(pattern + 1, name + 1);
+	}
+	return false;
+}
+
+static bool is_glob(const std::string& path) {
+	return path.find_first_of("*?") != std::string::npos;
+}
+
+// Find all the files matched by src_path, along with their paths relative to
+// it. Directories are walked recursively.
+static std::vector<std::pair<fs::path, fs::path>> find_matching_files(fs::path src_path) {
+	std::vector<std::pair<fs::path, fs::path>> files;
+	if(fs::is_directory(src_path)) {
+		for(auto iter = fs::recursive_directory_iterator(src_path); iter != fs::recursive_directory_iterator(); iter++) {
+			if(fs::is_regular_file(iter->path())) {
+				files.emplace_back(iter->path(), fs::relative(iter->path(), src_path));
+			}
+		}
+	} else {
+		fs::path parent = src_path.parent_path();
+		std::string pattern = src_path.filename().string();
+		for(auto iter = fs::directory_iterator(parent.empty() ? "." : parent); iter != fs::directory_iterator(); iter++) {
+			std::string name = iter->path().filename().string();
+			if(fs::is_regular_file(iter->path()) && glob_match(pattern.c_str(), name.c_str())) {
+				files.emplace_back(iter->path(), name);
+			}
+		}
+	}
+	std::sort(files.begin(), files.end());
+	return files;
+}
+
+// Work out where the outputs for each of the files matched by src_path should
+// go. The layout of directories is mirrored in the dest directory.
+static std::vector<cli_job> enumerate_cli_jobs(fs::path src_path, fs::path dest_dir, const char* extension) {
+	std::vector<cli_job> jobs;
+	for(auto& [src, relative] : find_matching_files(src_path)) {
+		jobs.push_back({ src, (dest_dir / relative).replace_extension(extension) });
+	}
+	return jobs;
+}
+
+std::vector<std::string> find_input_files(std::string src_path) {
+	if(!fs::is_directory(src_path) && !is_glob(src_path)) {
+		return { src_path };
+	}
+	std::vector<std::string> result;
+	for(auto& file : find_matching_files(src_path)) {
+		result.push_back(file.first.string());
+	}
+	return result;
+}
+
 int run_cli_converter(
 	int argc, char** argv,
 	const char* help_text,
-	std::map<std::string, stream_op> commands) {
+	std::map<std::string, cli_command> commands) {
 
 	std::string command;
 	std::string src_path;
 	std::string dest_path;
 	std::string offset_hex;
+	std::size_t num_threads;
 
 	std::string command_description =
 		"The operation to perform. Possible values are:";
@@ -82,11 +158,13 @@ int run_cli_converter(
 		("command,c", po::value<std::string>(&command)->required(),
 			command_description.c_str())
 		("src,s",    po::value<std::string>(&src_path)->required(),
-			"The input file.")
+			"The input file, or a directory or glob pattern to convert many files at once.")
 		("dest,d",   po::value<std::string>(&dest_path)->required(),
-			"The output file.")
+			"The output file, or the output directory if multiple files are being converted.")
 		("offset,o", po::value<std::string>(&offset_hex)->default_value("0"),
-			"The offset in the input file where the header begins.");
+			"The offset in the input file where the header begins.")
+		("jobs,j",   po::value<std::size_t>(&num_threads)->default_value(default_num_threads()),
+			"The maximum number of threads to use.");
 
 	po::positional_options_description pd;
 	pd.add("command", 1);
@@ -97,23 +175,51 @@ int run_cli_converter(
 		return 0;
 	}
 
-	file_stream src(src_path);
-	file_stream dest(dest_path, std::ios::in | std::ios::out | std::ios::trunc);
+	auto op = commands.find(command);
+	if(op == commands.end()) {
+		std::cerr << "Invalid command.\n";
+		return 1;
+	}
 
 	std::stringstream offset_stream;
 	offset_stream << std::hex << offset_hex;
 	std::size_t offset;
 	offset_stream >> offset;
-	
-	proxy_stream src_proxy(&src, offset, src.size() - offset);
 
-	auto op = commands.find(command);
-	if(op == commands.end()) {
-		std::cerr << "Invalid command.\n";
-		return 1;
+	auto convert = [&](const std::string& src_path, const std::string& dest_path) {
+		file_stream src(src_path);
+		file_stream dest(dest_path, std::ios::in | std::ios::out | std::ios::trunc);
+		proxy_stream src_proxy(&src, offset, src.size() - offset);
+		op->second.op(dest, src_proxy);
+	};
+
+	if(!fs::is_directory(src_path) && !is_glob(src_path)) {
+		convert(src_path, dest_path);
+		return 0;
 	}
 
-	(*op).second(dest, src_proxy);
+	std::vector<cli_job> jobs = enumerate_cli_jobs(src_path, dest_path, op->second.extension);
+	if(jobs.size() == 0) {
+		std::cerr << "No input files found.\n";
+		return 1;
+	}
 
-	return 0;
+	std::mutex cerr_mutex;
+	std::atomic<std::size_t> num_failed(0);
+	parallel_for(jobs.size(), num_threads, [&](std::size_t i) {
+		try {
+			fs::create_directories(jobs[i].dest.parent_path());
+			convert(jobs[i].src.string(), jobs[i].dest.string());
+		} catch(std::exception& e) {
+			// Don't let a failure to clean up stop the rest of the batch.
+			boost::system::error_code error;
+			fs::remove(jobs[i].dest, error);
+			num_failed++;
+			std::lock_guard<std::mutex> lock(cerr_mutex);
+			std::cerr << "Error: Failed to convert " << jobs[i].src.string() << ": " << e.what() << "\n";
+		}
+	});
+
+	std::cout << "Converted " << (jobs.size() - num_failed) << " of " << jobs.size() << " files.\n";
+	return num_failed == 0 ? 0 : 1;
 }
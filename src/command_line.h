@@ -19,6 +19,8 @@
 #ifndef COMMAND_LINE_H
 #define COMMAND_LINE_H
 
+#include <string>
+#include <vector>
 #include <functional>
 #include <boost/program_options.hpp>
 
@@ -37,9 +39,20 @@ bool parse_command_line_args(
 
 using stream_op = std::function<void(stream& dest, stream& src)>;
 
+struct cli_command {
+	stream_op op;
+	const char* extension; // Given to the output files in batch mode.
+};
+
+// If src_path is a directory or a glob pattern (e.g. "models/*.bin") returns
+// every file it matches in sorted order, otherwise returns src_path itself.
+std::vector<std::string> find_input_files(std::string src_path);
+
+// If src is a directory or a glob pattern (e.g. "textures/*.fip") every file
+// it matches is converted and the outputs are written to the dest directory.
 int run_cli_converter(
 	int argc, char** argv,
 	const char* help_text,
-	std::map<std::string, stream_op> commands);
+	std::map<std::string, cli_command> commands);
 
 #endif
@@ -0,0 +1,349 @@
+/*
+	wrench - A set of modding tools for the Ratchet & Clank PS2 games.
+	Copyright (C) 2019-2020 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "disc_catalogue.h"
+
+#include <array>
+#include <fstream>
+#include <iomanip>
+#include <unordered_set>
+#include <nlohmann/json.hpp>
+#include <boost/filesystem.hpp>
+
+#include "md5.h"
+#include "util.h"
+#include "formats/wad.h"
+#include "formats/fip.h"
+#include "formats/bmp.h"
+#include "formats/racpak.h"
+#include "formats/classifier.h"
+
+namespace fs = boost::filesystem;
+
+// Bump this if the format of the cache file or the scanning logic changes.
+static const int CATALOGUE_VERSION = 2;
+
+const catalogue_object* disc_catalogue::find(std::size_t offset) const {
+	auto iter = std::lower_bound(objects.begin(), objects.end(), offset,
+		[](const catalogue_object& object, std::size_t offset) { return object.offset < offset; });
+	if(iter == objects.end() || iter->offset != offset) {
+		return nullptr;
+	}
+	return &(*iter);
+}
+
+std::vector<const catalogue_object*> disc_catalogue::objects_of_type(const char* type) const {
+	std::vector<const catalogue_object*> result;
+	for(const catalogue_object& object : objects) {
+		if(object.type == type) {
+			result.push_back(&object);
+		}
+	}
+	return result;
+}
+
+void disc_catalogue::resolve_file_sizes(std::vector<gamedb_file>& files) const {
+	for(gamedb_file& file : files) {
+		if(file.size != 0) {
+			continue;
+		}
+
+		const catalogue_object* object = find(file.offset);
+		if(object != nullptr && object->type == "racpak") {
+			file.size = object->size;
+			continue;
+		}
+
+		// Otherwise assume the file extends up until the next one.
+		std::size_t end = file_size;
+		for(gamedb_file& other : files) {
+			if(other.offset > file.offset && other.offset < end) {
+				end = other.offset;
+			}
+		}
+		if(end > file.offset) {
+			file.size = end - file.offset;
+		}
+	}
+}
+
+std::string disc_fingerprint(std::string path) {
+	static const std::size_t num_samples = 16;
+	static const std::size_t sample_size = 0x10000;
+
+	MD5_CTX ctx;
+	MD5Init(&ctx);
+
+	file_stream src(path);
+	uint64_t size = src.size();
+	MD5Update(&ctx, reinterpret_cast<uint8_t*>(&size), sizeof(uint64_t));
+	int64_t modified = fs::last_write_time(path);
+	MD5Update(&ctx, reinterpret_cast<uint8_t*>(&modified), sizeof(int64_t));
+
+	std::vector<uint8_t> sample;
+	for(std::size_t i = 0; i < num_samples; i++) {
+		std::size_t offset = (size / num_samples) * i;
+		sample.resize(std::min(sample_size, size - offset));
+		src.seek(offset);
+		src.read_n(reinterpret_cast<char*>(sample.data()), sample.size());
+		MD5Update(&ctx, sample.data(), sample.size());
+	}
+
+	std::array<uint8_t, MD5_DIGEST_LENGTH> digest;
+	MD5Final(digest.data(), &ctx);
+
+	std::stringstream result;
+	result << std::hex << std::setfill('0');
+	for(uint8_t byte : digest) {
+		result << std::setw(2) << (int) byte;
+	}
+	return result.str();
+}
+
+// Size of an uncompressed segment, or zero if it can't be determined.
+static std::size_t segment_size(const content_match& match, const char* data, std::size_t size) {
+	if(match.is("fip") && size >= sizeof(fip_header)) {
+		fip_header header;
+		std::memcpy(&header, data, sizeof(fip_header));
+		return sizeof(fip_header) + header.width * header.height;
+	}
+	if(match.is("bmp") && size >= sizeof(bmp_file_header)) {
+		bmp_file_header header;
+		std::memcpy(&header, data, sizeof(bmp_file_header));
+		return header.file_size;
+	}
+	return 0;
+}
+
+disc_catalogue build_disc_catalogue(std::string path, std::string fingerprint, std::size_t num_threads) {
+	static const std::size_t shard_size = 0x2000000; // 32 MiB.
+	static const std::size_t max_checked_entries = 32;
+	// Extra data read past the end of each shard, so that racpak tables of
+	// contents that start near the end of a shard are checked in full.
+	static const std::size_t lookahead = MAX_RACPAK_TOC_SIZE;
+
+	struct racpak_candidate {
+		std::size_t offset;
+		std::size_t num_entries;
+		std::vector<std::size_t> entries; // Absolute offsets of the first few entries.
+	};
+
+	struct shard_result {
+		std::vector<catalogue_object> objects;
+		std::vector<racpak_candidate> candidates;
+	};
+
+	disc_catalogue catalogue;
+	catalogue.fingerprint = fingerprint;
+	catalogue.file_size = file_stream(path).size();
+
+	// VIF chains are left out since they're only ever found inside other
+	// segments, and plausible ones turn up all over the place.
+	content_classifier classifier = default_classifier({ "wad", "fip", "bmp", "racpak" });
+
+	// Used to work out what's inside WAD segments.
+	content_classifier contents_classifier = default_classifier({ "fip", "bmp" });
+
+	std::vector<shard_result> shards((catalogue.file_size + shard_size - 1) / shard_size);
+	parallel_for(shards.size(), num_threads, [&](std::size_t shard_index) {
+		shard_result& result = shards[shard_index];
+
+		std::size_t shard_begin = shard_index * shard_size;
+		std::size_t shard_end = std::min(shard_begin + shard_size, catalogue.file_size);
+		std::vector<char> buffer(std::min(shard_end + lookahead, catalogue.file_size) - shard_begin);
+		file_stream src(path);
+		src.seek(shard_begin);
+		src.read_n(buffer.data(), buffer.size());
+
+		std::optional<std::size_t> last_sector;
+		for(const content_match& match : classifier.classify(buffer.data(), buffer.size(), SECTOR_SIZE, shard_end - shard_begin)) {
+			std::size_t sector = match.offset - match.offset % SECTOR_SIZE;
+			const char* data = buffer.data() + match.offset;
+			std::size_t size = buffer.size() - match.offset;
+
+			if(match.is("racpak")) {
+				std::size_t num_entries = *racpak_toc_num_entries(data, size);
+				racpak_candidate candidate { shard_begin + sector, num_entries, {} };
+				std::size_t num_checked = std::min({ num_entries, (size - 8) / 8, max_checked_entries });
+				for(std::size_t i = 0; i < num_checked; i++) {
+					uint32_t entry_sector;
+					std::memcpy(&entry_sector, data + (i + 1) * 8, 4);
+					if(entry_sector != 0) {
+						candidate.entries.push_back(candidate.offset + entry_sector * SECTOR_SIZE);
+					}
+				}
+				result.candidates.emplace_back(std::move(candidate));
+				continue;
+			}
+
+			if(last_sector == sector) {
+				continue; // Only record one segment per sector.
+			}
+			last_sector = sector;
+
+			catalogue_object object;
+			object.offset = shard_begin + sector;
+			object.header_offset = match.offset - sector;
+			if(match.is("wad")) {
+				wad_header header;
+				std::memcpy(&header, data, sizeof(wad_header));
+				object.size = header.total_size;
+				object.type = "unknown";
+				object.compressed = true;
+				try {
+					array_stream decompressed;
+					decompress_wad_prefix(decompressed, src, object.offset, 0x10 + sizeof(fip_header));
+					for(const content_match& inner : contents_classifier.classify_at(decompressed.data(), decompressed.size())) {
+						object.type = inner.signature->name;
+						object.header_offset = inner.offset;
+						break;
+					}
+				} catch(stream_error& e) {
+					// Corrupted or not actually a WAD segment.
+				}
+			} else {
+				object.size = object.header_offset + segment_size(match, data, size);
+				object.type = match.signature->name;
+			}
+			result.objects.emplace_back(std::move(object));
+		}
+	});
+
+	std::unordered_set<std::size_t> segments;
+	for(shard_result& shard : shards) {
+		for(catalogue_object& object : shard.objects) {
+			segments.insert(object.offset);
+		}
+	}
+
+	// Only keep racpaks that point to at least one known segment.
+	file_stream src(path);
+	for(shard_result& shard : shards) {
+		for(racpak_candidate& candidate : shard.candidates) {
+			std::size_t hits = std::count_if(candidate.entries.begin(), candidate.entries.end(),
+				[&](std::size_t entry) { return segments.find(entry) != segments.end(); });
+			if(hits == 0) {
+				continue;
+			}
+
+			catalogue_object object;
+			object.offset = candidate.offset;
+			object.type = "racpak";
+			object.num_entries = candidate.num_entries;
+			object.confidence = hits / (float) candidate.entries.size();
+
+			racpak archive(&src, candidate.offset, catalogue.file_size - candidate.offset);
+			object.size = (candidate.num_entries + 1) * 8;
+			for(std::size_t i = 0; i < candidate.num_entries; i++) {
+				racpak_entry entry = archive.entry(i);
+				if(entry.offset + entry.size <= catalogue.file_size - candidate.offset) {
+					object.size = std::max(object.size, entry.offset + entry.size);
+				}
+			}
+			shard.objects.emplace_back(std::move(object));
+		}
+
+		catalogue.objects.insert(catalogue.objects.end(),
+			shard.objects.begin(), shard.objects.end());
+	}
+
+	std::stable_sort(catalogue.objects.begin(), catalogue.objects.end(),
+		[](const catalogue_object& lhs, const catalogue_object& rhs) { return lhs.offset < rhs.offset; });
+
+	return catalogue;
+}
+
+static nlohmann::json catalogue_to_json(const disc_catalogue& catalogue) {
+	std::vector<nlohmann::json> objects;
+	for(const catalogue_object& object : catalogue.objects) {
+		nlohmann::json object_json {
+			{ "offset", object.offset },
+			{ "size", object.size },
+			{ "type", object.type },
+			{ "header_offset", object.header_offset },
+			{ "compressed", object.compressed }
+		};
+		if(object.type == "racpak") {
+			object_json["num_entries"] = object.num_entries;
+			object_json["confidence"] = object.confidence;
+		}
+		objects.emplace_back(std::move(object_json));
+	}
+
+	nlohmann::json result;
+	result["version"] = CATALOGUE_VERSION;
+	result["fingerprint"] = catalogue.fingerprint;
+	result["file_size"] = catalogue.file_size;
+	result["objects"] = objects;
+	return result;
+}
+
+static disc_catalogue catalogue_from_json(const nlohmann::json& json) {
+	disc_catalogue catalogue;
+	catalogue.fingerprint = json["fingerprint"].get<std::string>();
+	catalogue.file_size = json["file_size"].get<std::size_t>();
+	for(const nlohmann::json& object_json : json["objects"]) {
+		catalogue_object object;
+		object.offset = object_json["offset"].get<std::size_t>();
+		object.size = object_json["size"].get<std::size_t>();
+		object.type = object_json["type"].get<std::string>();
+		object.header_offset = object_json["header_offset"].get<std::size_t>();
+		object.compressed = object_json["compressed"].get<bool>();
+		if(object.type == "racpak") {
+			object.num_entries = object_json["num_entries"].get<std::size_t>();
+			object.confidence = object_json["confidence"].get<float>();
+		}
+		catalogue.objects.emplace_back(std::move(object));
+	}
+	return catalogue;
+}
+
+disc_catalogue open_disc_catalogue(std::string path, std::size_t num_threads, catalogue_status* status) {
+	std::string fingerprint = disc_fingerprint(path);
+	std::string cache_path = std::string("cache/catalogue_") + fingerprint + ".json";
+
+	catalogue_status result_status = catalogue_status::MISSING;
+	if(fs::exists(cache_path)) {
+		try {
+			std::ifstream cache_file(cache_path);
+			nlohmann::json json;
+			cache_file >> json;
+			if(json["version"] == CATALOGUE_VERSION && json["fingerprint"] == fingerprint) {
+				if(status != nullptr) {
+					*status = catalogue_status::CACHED;
+				}
+				return catalogue_from_json(json);
+			}
+		} catch(nlohmann::json::exception& e) {
+			// Fall through and rebuild it.
+		}
+		result_status = catalogue_status::STALE;
+	}
+	if(status != nullptr) {
+		*status = result_status;
+	}
+
+	disc_catalogue catalogue = build_disc_catalogue(path, fingerprint, num_threads);
+
+	fs::create_directories("cache");
+	std::string json_str = catalogue_to_json(catalogue).dump(1, '\t');
+	std::ofstream cache_file(cache_path, std::ios::trunc);
+	cache_file.write(json_str.data(), json_str.size());
+
+	return catalogue;
+}
@@ -0,0 +1,77 @@
+/*
+	wrench - A set of modding tools for the Ratchet & Clank PS2 games.
+	Copyright (C) 2019-2020 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef DISC_CATALOGUE_H
+#define DISC_CATALOGUE_H
+
+#include <string>
+#include <vector>
+#include <optional>
+
+#include "stream.h"
+#include "game_db.h"
+
+# /*
+#	Index of every known segment on a disc image, built by scanning it once
+#	and then cached in the cache/ directory, keyed by a fingerprint of the
+#	image. Only the unmodified image is scanned, not the patched copy.
+# */
+
+struct catalogue_object {
+	std::size_t offset; // Absolute, sector aligned.
+	std::size_t size; // On disc, so for compressed segments the compressed size.
+	std::string type; // Classifier name of the (decompressed) contents, or "unknown".
+	std::size_t header_offset = 0; // e.g. 0x10 for 2FIP textures with a prefix.
+	bool compressed = false;
+
+	// Racpaks only.
+	std::size_t num_entries = 0;
+	float confidence = 0.f; // Fraction of checked entries that are known segments.
+};
+
+struct disc_catalogue {
+	std::string fingerprint;
+	std::size_t file_size = 0;
+	std::vector<catalogue_object> objects; // Sorted by offset.
+
+	const catalogue_object* find(std::size_t offset) const;
+	std::vector<const catalogue_object*> objects_of_type(const char* type) const;
+
+	// Fill in the sizes of files that gamedb.txt lists as 0x0.
+	void resolve_file_sizes(std::vector<gamedb_file>& files) const;
+};
+
+// Cheap to compute: only a few samples of the file are hashed, along with its
+// size and modification time, so that a patched image of the same size
+// doesn't match the catalogue of the original.
+std::string disc_fingerprint(std::string path);
+
+disc_catalogue build_disc_catalogue(std::string path, std::string fingerprint, std::size_t num_threads);
+
+// Where open_disc_catalogue got the catalogue from.
+enum class catalogue_status {
+	CACHED,
+	MISSING, // There was no cache file, so the disc was scanned.
+	STALE // The cache file was for an older version, so the disc was scanned.
+};
+
+// Load the catalogue for the given file from the cache, or build it and save
+// it to the cache if there isn't one yet.
+disc_catalogue open_disc_catalogue(std::string path, std::size_t num_threads, catalogue_status* status = nullptr);
+
+#endif
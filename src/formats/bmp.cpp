@@ -21,13 +21,14 @@
 #include <cstring>
 
 #include "texture.h"
+#include "quantiser.h"
 
 bool validate_bmp(bmp_file_header header) {
 	return std::memcmp(header.magic, "BM", 2) == 0;
 }
 
-void texture_to_bmp(stream& dest, texture* src) {
-	auto size = src->size();
+void write_indexed_bmp(stream& dest, const bmp_indexed_image& image, uint32_t reserved) {
+	uint32_t row_size = ((8 * image.width + 31) / 32) * 4;
 
 	bmp_file_header header;
 	std::memcpy(header.magic, "BM", 2);
@@ -37,14 +38,13 @@ void texture_to_bmp(stream& dest, texture* src) {
 		sizeof(bmp_colour_table_entry) * 256;
 	header.file_size =
 		header.pixel_data.value +
-		size.x * size.y;
-	header.reserved = 0x3713;
-	dest.write<bmp_file_header>(0, header);
+		row_size * image.height;
+	header.reserved = reserved;
 
 	bmp_info_header info;
 	info.info_header_size      = 40;
-	info.width                 = size.x;
-	info.height                = size.y;
+	info.width                 = image.width;
+	info.height                = image.height;
 	info.num_colour_planes     = 1;
 	info.bits_per_pixel        = 8;
 	info.compression_method    = 0;
@@ -53,27 +53,24 @@ void texture_to_bmp(stream& dest, texture* src) {
 	info.vertical_resolution   = 0;
 	info.num_colours           = 256;
 	info.num_important_colours = 0;
-	dest.write<bmp_info_header>(info);
 
-	auto palette = src->palette();
-	for(int i = 0; i < 256; i++) {
-		bmp_colour_table_entry pixel;
-		pixel.b = palette[i].b;
-		pixel.g = palette[i].g;
-		pixel.r = palette[i].r;
-		pixel.pad = 0;
-		dest.write<bmp_colour_table_entry>(pixel);
-	}
+	std::vector<char> buffer(header.file_size, 0);
+	std::memcpy(&buffer[0], &header, sizeof(bmp_file_header));
+	std::memcpy(&buffer[sizeof(bmp_file_header)], &info, sizeof(bmp_info_header));
+	std::memcpy(&buffer[sizeof(bmp_file_header) + sizeof(bmp_info_header)],
+		image.palette.data(), sizeof(bmp_colour_table_entry) * 256);
 
-	uint32_t row_size = ((info.bits_per_pixel * info.width + 31) / 32) * 4;
-	auto pixels = src->pixel_data();
-	for(int y = info.height - 1; y >= 0; y--) {
-		dest.write_n(reinterpret_cast<char*>(pixels.data()) + y * row_size, row_size);
+	// BMP files are stored bottom to top.
+	for(int32_t y = 0; y < image.height; y++) {
+		std::size_t dest_row = header.pixel_data.value + (image.height - y - 1) * row_size;
+		std::memcpy(&buffer[dest_row], &image.pixels[y * image.width], image.width);
 	}
-}
 
+	dest.seek(0);
+	dest.write_v(buffer);
+}
 
-void bmp_to_texture(texture* dest, stream& src) {
+bmp_indexed_image read_indexed_bmp(stream& src, bool dither) {
 	auto file_header = src.read<bmp_file_header>(0);
 
 	if(!validate_bmp(file_header)) {
@@ -83,26 +80,105 @@ void bmp_to_texture(texture* dest, stream& src) {
 	uint32_t secondary_header_offset = src.tell();
 	auto info_header = src.read<bmp_info_header>();
 
-	if(info_header.bits_per_pixel != 8) {
-		throw stream_format_error("The BMP file must use indexed colour (with at most 256 colours).");
+	int32_t bytes_per_pixel = info_header.bits_per_pixel / 8;
+	if(info_header.bits_per_pixel != 8 && info_header.bits_per_pixel != 24 && info_header.bits_per_pixel != 32) {
+		throw stream_format_error("The BMP file must use 8-bit indexed colour, or 24 or 32-bit colour.");
+	}
+
+	// Bitfields are only allowed for 32-bit images, and are assumed to be in
+	// the usual BGRA order.
+	if(info_header.compression_method != 0 && !(info_header.compression_method == 3 && bytes_per_pixel == 4)) {
+		throw stream_format_error("Compressed BMP files are not supported.");
 	}
 
 	if(info_header.num_colours > 256) {
 		throw stream_format_error("The BMP colour palette must contain at most 256 colours.");
 	}
 
-	vec2i size { info_header.width, info_header.height };
-	if(dest->size() == size) {
+	if(info_header.width <= 0 || info_header.height <= 0) {
+		throw stream_format_error("Only bottom-up BMP files with a non-zero size are supported.");
+	}
+
+	bmp_indexed_image image;
+	image.width = info_header.width;
+	image.height = info_header.height;
+	image.num_colours = info_header.num_colours;
+
+	if(bytes_per_pixel == 1) {
+		// Some BMP files have a larger header.
+		std::memset(image.palette.data(), 0, sizeof(bmp_colour_table_entry) * 256);
+		src.seek(secondary_header_offset + info_header.info_header_size);
+		src.read_n(reinterpret_cast<char*>(image.palette.data()), sizeof(bmp_colour_table_entry) * image.num_colours);
+	}
+
+	// The padding after the last row may be missing, so don't read it.
+	uint32_t row_size = ((info_header.bits_per_pixel * image.width + 31) / 32) * 4;
+	std::vector<uint8_t> padded(row_size * (image.height - 1) + image.width * bytes_per_pixel);
+	src.seek(file_header.pixel_data.value);
+	src.read_v(padded);
+
+	if(bytes_per_pixel == 1) {
+		image.pixels.resize(image.width * image.height);
+		for(int32_t y = 0; y < image.height; y++) {
+			std::size_t src_row = (image.height - y - 1) * row_size;
+			std::memcpy(&image.pixels[y * image.width], &padded[src_row], image.width);
+		}
+		return image;
+	}
+
+	std::vector<colour> truecolour(image.width * image.height);
+	for(int32_t y = 0; y < image.height; y++) {
+		const uint8_t* src_row = &padded[(image.height - y - 1) * row_size];
+		colour* dest_row = &truecolour[y * image.width];
+		for(int32_t x = 0; x < image.width; x++) {
+			const uint8_t* pixel = src_row + x * bytes_per_pixel;
+			dest_row[x] = { pixel[2], pixel[1], pixel[0], 0x80 };
+		}
+	}
+
+	quantised_image quantised = quantise(truecolour, image.width, image.height, dither);
+	image.num_colours = quantised.palette.size();
+	std::memset(image.palette.data(), 0, sizeof(bmp_colour_table_entry) * 256);
+	for(std::size_t i = 0; i < quantised.palette.size(); i++) {
+		const colour& c = quantised.palette[i];
+		image.palette[i] = { c.b, c.g, c.r, 0 };
+	}
+	image.pixels = std::move(quantised.indices);
+	return image;
+}
+
+bmp_indexed_image bmp_image_from_texture(texture* src) {
+	auto size = src->size();
+
+	bmp_indexed_image image;
+	image.width = size.x;
+	image.height = size.y;
+	image.num_colours = 256;
+
+	auto palette = src->palette();
+	for(int i = 0; i < 256; i++) {
+		image.palette[i] = { palette[i].b, palette[i].g, palette[i].r, 0 };
+	}
+
+	image.pixels = src->pixel_data();
+	image.pixels.resize(image.width * image.height);
+	return image;
+}
+
+void texture_to_bmp(stream& dest, texture* src) {
+	write_indexed_bmp(dest, bmp_image_from_texture(src), 0x3713);
+}
+
+void bmp_image_to_texture(texture* dest, const bmp_indexed_image& image) {
+	vec2i size { image.width, image.height };
+	if(!(dest->size() == size)) {
 		throw stream_format_error("Texture size mismatch.");
 	}
 
-	// Some BMP files have a larger header.
-	src.seek(secondary_header_offset + info_header.info_header_size);
-	
 	std::array<colour, 256> palette;
 	uint32_t i;
-	for(i = 0; i < info_header.num_colours; i++) {
-		auto src_pixel = src.read<bmp_colour_table_entry>();
+	for(i = 0; i < image.num_colours; i++) {
+		auto& src_pixel = image.palette[i];
 		palette[i] = { src_pixel.r, src_pixel.g, src_pixel.b, 0x80 };
 	}
 	for(; i < 256; i++) {
@@ -110,11 +186,9 @@ void bmp_to_texture(texture* dest, stream& src) {
 		palette[i] = { 0, 0, 0, 0x80 };
 	}
 	dest->set_palette(palette);
+	dest->set_pixel_data(image.pixels);
+}
 
-	uint32_t row_size = ((info_header.bits_per_pixel * info_header.width + 31) / 32) * 4;
-	std::vector<uint8_t> pixels(info_header.width * info_header.height);
-	for(int y = info_header.height - 1; y >= 0; y--) {
-		src.read_n(reinterpret_cast<char*>(pixels.data()) + y * row_size, row_size);
-	}
-	dest->set_pixel_data(pixels);
+void bmp_to_texture(texture* dest, stream& src) {
+	bmp_image_to_texture(dest, read_indexed_bmp(src));
 }
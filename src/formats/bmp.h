@@ -19,6 +19,9 @@
 #ifndef FORMATS_BMP_H
 #define FORMATS_BMP_H
 
+#include <array>
+#include <vector>
+
 #include "../stream.h"
 
 # /*
@@ -62,8 +65,25 @@ packed_struct(bmp_colour_table_entry,
 	uint8_t pad;
 )
 
+// An 8-bit indexed colour image, with its rows stored top to bottom and
+// without any padding.
+struct bmp_indexed_image {
+	int32_t width;
+	int32_t height;
+	uint32_t num_colours; // Entries past this are zeroed.
+	std::array<bmp_colour_table_entry, 256> palette;
+	std::vector<uint8_t> pixels;
+};
+
 bool validate_bmp(bmp_file_header header);
+// These assemble/parse the whole file in memory and do a single write/read
+// of the pixel data, instead of going through the stream row by row.
+void write_indexed_bmp(stream& dest, const bmp_indexed_image& image, uint32_t reserved);
+// 24 and 32 bit images are quantised down to 256 colours.
+bmp_indexed_image read_indexed_bmp(stream& src, bool dither = false);
+bmp_indexed_image bmp_image_from_texture(texture* src);
 void texture_to_bmp(stream& dest, texture* src);
+void bmp_image_to_texture(texture* dest, const bmp_indexed_image& image);
 void bmp_to_texture(texture* dest, stream& src);
 
 #endif
@@ -0,0 +1,197 @@
+/*
+	wrench - A set of modding tools for the Ratchet & Clank PS2 games.
+	Copyright (C) 2019-2020 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "classifier.h"
+
+#include <cstring>
+#include <algorithm>
+
+#include "wad.h"
+#include "fip.h"
+#include "bmp.h"
+#include "vif.h"
+
+void content_classifier::add(content_signature signature) {
+	_signatures.emplace_back(std::move(signature));
+}
+
+std::vector<content_match> content_classifier::classify(const char* data, std::size_t size, std::size_t stride, std::size_t end) const {
+	std::vector<content_match> matches;
+	end = std::min(end, size);
+	for(std::size_t offset = 0; offset < end; offset += stride) {
+		for(const content_signature& signature : _signatures) {
+			if(size - offset < signature.min_size) {
+				continue;
+			}
+			std::optional<std::size_t> match = signature.test(data + offset, size - offset);
+			if(match) {
+				matches.push_back({ &signature, offset + *match });
+			}
+		}
+	}
+	return matches;
+}
+
+std::vector<content_match> content_classifier::classify(const char* data, std::size_t size, std::size_t stride) const {
+	return classify(data, size, stride, size);
+}
+
+std::vector<content_match> content_classifier::classify_at(const char* data, std::size_t size) const {
+	return classify(data, size, 1, 1);
+}
+
+content_signature wad_signature() {
+	return { "wad", sizeof(wad_header), [](const char* data, std::size_t) -> std::optional<std::size_t> {
+		wad_header header;
+		std::memcpy(&header, data, sizeof(wad_header));
+		if(validate_wad(header.magic) && header.total_size >= sizeof(wad_header)) {
+			return 0;
+		}
+		return {};
+	} };
+}
+
+content_signature fip_signature() {
+	return { "fip", 0x14, [](const char* data, std::size_t) -> std::optional<std::size_t> {
+		if(validate_fip(data)) {
+			return 0;
+		}
+		if(validate_fip(data + 0x10)) {
+			return 0x10;
+		}
+		return {};
+	} };
+}
+
+content_signature racpak_signature() {
+	return { "racpak", 0x10, [](const char* data, std::size_t size) -> std::optional<std::size_t> {
+		std::optional<std::size_t> num_entries = racpak_toc_num_entries(data, size);
+		if(!num_entries) {
+			return {};
+		}
+		// At least one of the first few entries should point somewhere.
+		std::size_t num_checked = std::min({ *num_entries, (size - 8) / 8, (std::size_t) 32 });
+		for(std::size_t i = 0; i < num_checked; i++) {
+			uint32_t entry_sector;
+			std::memcpy(&entry_sector, data + (i + 1) * 8, 4);
+			if(entry_sector != 0) {
+				return 0;
+			}
+		}
+		return {};
+	} };
+}
+
+content_signature vif_signature() {
+	// A chain is considered plausible if the first few codes are valid, fit
+	// inside the buffer and include at least one UNPACK. Zeroed memory parses
+	// as a chain of NOPs, hence the last requirement.
+	static const std::size_t codes_to_check = 8;
+	return { "vif", 4 * codes_to_check, [](const char* data, std::size_t size) -> std::optional<std::size_t> {
+		std::size_t offset = 0;
+		bool has_unpack = false;
+		int wl = 1;
+		int cl = 1;
+		for(std::size_t i = 0; i < codes_to_check; i++) {
+			if(offset + 4 > size) {
+				return {};
+			}
+			uint32_t val;
+			std::memcpy(&val, data + offset, 4);
+			std::optional<vif_code> code = vif_code::parse(val);
+			if(!code) {
+				return {};
+			}
+			if(code->cmd == vif_cmd::STCYCL) {
+				wl = code->stcycl.wl;
+				cl = code->stcycl.cl;
+			}
+			std::size_t packet_size = code->packet_size(wl, cl);
+			if(packet_size > 0x10000 || offset + packet_size > size) {
+				return {};
+			}
+			has_unpack |= code->is_unpack();
+			offset += packet_size;
+		}
+		if(has_unpack) {
+			return 0;
+		}
+		return {};
+	} };
+}
+
+content_signature bmp_signature() {
+	return { "bmp", sizeof(bmp_file_header) + sizeof(bmp_info_header), [](const char* data, std::size_t) -> std::optional<std::size_t> {
+		bmp_file_header file_header;
+		bmp_info_header info_header;
+		std::memcpy(&file_header, data, sizeof(bmp_file_header));
+		std::memcpy(&info_header, data + sizeof(bmp_file_header), sizeof(bmp_info_header));
+		if(!validate_bmp(file_header) || info_header.num_colour_planes != 1) {
+			return {};
+		}
+		switch(info_header.bits_per_pixel) {
+			case 1: case 4: case 8: case 16: case 24: case 32:
+				return 0;
+		}
+		return {};
+	} };
+}
+
+static std::vector<content_signature> default_signatures() {
+	return {
+		wad_signature(),
+		fip_signature(),
+		racpak_signature(),
+		vif_signature(),
+		bmp_signature()
+	};
+}
+
+content_classifier default_classifier() {
+	content_classifier classifier;
+	for(content_signature& signature : default_signatures()) {
+		classifier.add(std::move(signature));
+	}
+	return classifier;
+}
+
+content_classifier default_classifier(const std::vector<std::string>& names) {
+	content_classifier classifier;
+	for(content_signature& signature : default_signatures()) {
+		if(std::find(names.begin(), names.end(), signature.name) != names.end()) {
+			classifier.add(std::move(signature));
+		}
+	}
+	return classifier;
+}
+
+std::optional<std::size_t> racpak_toc_num_entries(const char* data, std::size_t size) {
+	if(size < 0x10) {
+		return {};
+	}
+	uint32_t header_size;
+	std::memcpy(&header_size, data, 4);
+	if(header_size < 8) {
+		std::memcpy(&header_size, data + 4, 4);
+	}
+	std::size_t num_entries = header_size / 8 - 1;
+	if(header_size < 16 || num_entries > MAX_RACPAK_TOC_ENTRIES) {
+		return {};
+	}
+	return num_entries;
+}
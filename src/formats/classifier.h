@@ -0,0 +1,85 @@
+/*
+	wrench - A set of modding tools for the Ratchet & Clank PS2 games.
+	Copyright (C) 2019-2020 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef FORMATS_CLASSIFIER_H
+#define FORMATS_CLASSIFIER_H
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <functional>
+
+# /*
+#	Recognise known data segments (WAD, 2FIP, racpak, VIF, BMP) in a buffer.
+#	Every registered signature is tested at each position in a single pass, so
+#	tools that look for several kinds of data only need to read the input once.
+# */
+
+struct content_signature {
+	std::string name; // e.g. "wad", "fip".
+	std::size_t min_size; // Number of bytes test needs to be able to read.
+	// Returns the offset of the matched structure relative to data, which
+	// may be non-zero e.g. for 2FIP textures with a 0x10 byte prefix.
+	std::function<std::optional<std::size_t>(const char* data, std::size_t size)> test;
+};
+
+struct content_match {
+	const content_signature* signature;
+	std::size_t offset; // Relative to the start of the classified buffer.
+
+	bool is(const char* name) const { return signature->name == name; }
+};
+
+class content_classifier {
+public:
+	void add(content_signature signature);
+
+	// Test every signature at offsets 0, stride, 2 * stride, ... that are less
+	// than end. The buffer may extend past end so that structures near the end
+	// can still be recognised. Matches are returned in order of offset.
+	std::vector<content_match> classify(const char* data, std::size_t size, std::size_t stride, std::size_t end) const;
+	std::vector<content_match> classify(const char* data, std::size_t size, std::size_t stride) const;
+
+	// Test every signature at the start of the buffer only.
+	std::vector<content_match> classify_at(const char* data, std::size_t size) const;
+
+private:
+	std::vector<content_signature> _signatures;
+};
+
+content_signature wad_signature();
+content_signature fip_signature(); // At offset 0x0 or 0x10.
+content_signature racpak_signature();
+content_signature vif_signature();
+content_signature bmp_signature();
+
+// All of the above.
+content_classifier default_classifier();
+// Only the named signatures out of the above, e.g. { "wad", "fip" }.
+content_classifier default_classifier(const std::vector<std::string>& names);
+
+// Same logic as racpak::num_entries, but rejects tables of contents that are
+// obviously invalid.
+std::optional<std::size_t> racpak_toc_num_entries(const char* data, std::size_t size);
+
+// Limits on the tables of contents that racpak_toc_num_entries accepts. The
+// size is in bytes.
+static const std::size_t MAX_RACPAK_TOC_ENTRIES = 4096;
+static const std::size_t MAX_RACPAK_TOC_SIZE = (MAX_RACPAK_TOC_ENTRIES + 1) * 8;
+
+#endif
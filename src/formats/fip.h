@@ -45,9 +45,11 @@ packed_struct(fip_header,
 	uint8_t           data[0];
 )
 
-bool validate_fip(char* header);
+bool validate_fip(const char* header);
 void fip_to_bmp(stream& dest, stream& src);
 void bmp_to_fip(stream& dest, stream& src);
 uint8_t decode_palette_index(uint8_t index);
+// Decode a whole buffer of indices. dest and src may be the same buffer.
+void decode_palette_indices(uint8_t* dest, const uint8_t* src, std::size_t count);
 
 #endif
@@ -18,20 +18,50 @@
 
 #include "game_model.h"
 
+#include <algorithm>
 #include <glm/glm.hpp>
 
 #include "../util.h"
 
 game_model::game_model(stream* backing, std::size_t base_offset, std::size_t submodel_table_offset, std::size_t num_submodels_)
 	:  num_submodels(num_submodels_),
-	  _backing(backing, base_offset, 0),
-	  _submodel_table_offset(submodel_table_offset) {}
+	  // The size of the model isn't known, so let it extend to the end of the
+	  // backing stream. parse_vif_chain won't read past the end of this.
+	  _backing(backing, base_offset, SIZE_MAX),
+	  _submodel_table_offset(submodel_table_offset),
+	  _vif_chains(std::make_shared<vif_chain_cache>()) {
+	// The backing stream is shared with the rest of the level, so only the
+	// thread constructing the model may read from it. Take a copy of each
+	// chain now so get_vif_chain can be called from other threads.
+	std::size_t stream_size = _backing.size();
+	for(std::size_t i = 0; i < num_submodels; i++) {
+		vif_chain_snapshot snapshot;
+		snapshot.address = 0;
+		snapshot.qwc = 0;
+		try {
+			auto entry = get_submodel_entry(i);
+			snapshot.address = entry.address;
+			snapshot.qwc = entry.qwc;
+			if(snapshot.address < stream_size) {
+				std::size_t size = std::min(snapshot.qwc * 0x10, stream_size - snapshot.address);
+				snapshot.data.resize(size);
+				_backing.peek_n(snapshot.data.data(), snapshot.address, size);
+			}
+		} catch(stream_error& e) {
+			snapshot.error = e.what();
+		}
+		_vif_chains->submodels.emplace_back(std::move(snapshot));
+	}
+}
 
 std::vector<float> game_model::triangles() const {
 	std::vector<float> result;
 	
 	// I'm not entirely sure how the vertex data is stored, and this code
 	// doesn't work very well. More research is needed.
+	// TODO: Read vertices out of the VU1 memory image vif1_executor produces
+	// for each microprogram call. That's deferred until the layout the
+	// microprograms expect is known.
 	for(std::size_t i = 0; i < num_submodels; i++) {
 		auto entry = get_submodel_entry(i);
 		uint32_t base = entry.address_8;
@@ -57,24 +87,39 @@ std::vector<float> game_model::triangles() const {
 	return result;
 }
 
-std::vector<vif_packet> game_model::get_vif_chain(std::size_t submodel) const {
-	auto entry = get_submodel_entry(submodel);
-	return get_vif_chain_at(entry.address, entry.qwc);
+vif_chain_ptr game_model::get_vif_chain(std::size_t submodel) const {
+	std::lock_guard<std::mutex> lock(_vif_chains->mutex);
+	vif_chain_snapshot& snapshot = _vif_chains->submodels.at(submodel);
+	if(snapshot.chain) {
+		return snapshot.chain;
+	}
+	
+	std::vector<vif_packet> chain;
+	if(snapshot.error != "") {
+		vif_packet vpkt;
+		vpkt.address = snapshot.address;
+		vpkt.error = snapshot.error;
+		chain.push_back(vpkt);
+	} else {
+		// Streams aren't safe to share between threads, even array_streams,
+		// so parse from a private one.
+		array_stream data;
+		data.write_n(snapshot.data.data(), snapshot.data.size());
+		chain = parse_vif_chain(&data, 0, snapshot.qwc);
+		for(vif_packet& vpkt : chain) {
+			vpkt.address += snapshot.address;
+		}
+	}
+	
+	snapshot.chain = std::make_shared<const std::vector<vif_packet>>(std::move(chain));
+	std::vector<char>().swap(snapshot.data);
+	return snapshot.chain;
 }
 
 std::string game_model::resource_path() {
 	return _backing.resource_path();
 }
 
-std::vector<vif_packet> game_model::get_vif_chain_at(std::size_t offset, std::size_t qwc) const {
-	if(_vif_chains.find(offset) == _vif_chains.end()) {
-		const_cast<vif_chains*>(&_vif_chains)->insert
-			({offset, parse_vif_chain(&_backing, offset, qwc)});
-	}
-	
-	return _vif_chains.at(offset);
-}
-
 game_model::fmt::submodel_entry game_model::get_submodel_entry(std::size_t submodel) const {
 	uint32_t offset = _submodel_table_offset + submodel * sizeof(fmt::submodel_entry);
 	return _backing.peek<fmt::submodel_entry>(offset);
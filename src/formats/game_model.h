@@ -19,7 +19,10 @@
 #ifndef FORMATS_GAME_MODEL_H
 #define FORMATS_GAME_MODEL_H
 
-#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <memory>
 
 #include "../model.h"
 #include "../stream.h"
@@ -29,7 +32,7 @@
 #	Parse a game model.
 # */
 
-using vif_chains = std::map<std::size_t, std::vector<vif_packet>>;
+using vif_chain_ptr = std::shared_ptr<const std::vector<vif_packet>>;
 
 class game_model : public model {
 public:
@@ -65,18 +68,35 @@ public:
 
 	std::vector<float> triangles() const override;
 	
-	std::vector<vif_packet> get_vif_chain(std::size_t submodel) const;
+	// Parsed once and then shared, so it's cheap to call every frame. Safe to
+	// call from any thread, since it only reads from the snapshot taken when
+	// the model was constructed and never touches the backing stream.
+	vif_chain_ptr get_vif_chain(std::size_t submodel) const;
 	
 	std::string resource_path();
 	
 	const std::size_t num_submodels;
 private:
-	std::vector<vif_packet> get_vif_chain_at(std::size_t offset, std::size_t qwc) const;
+	// The raw chain of a submodel, read from the backing stream up front.
+	struct vif_chain_snapshot {
+		std::size_t address; // Relative to base_offset.
+		std::size_t qwc;
+		std::vector<char> data; // Freed once the chain has been parsed.
+		std::string error;
+		vif_chain_ptr chain;
+	};
+	
+	// Shared between copies of the same model.
+	struct vif_chain_cache {
+		std::mutex mutex;
+		std::vector<vif_chain_snapshot> submodels;
+	};
+	
 	fmt::submodel_entry get_submodel_entry(std::size_t submodel) const;
 	
 	proxy_stream _backing;
 	std::size_t _submodel_table_offset; // Relative to base_offset.
-	vif_chains _vif_chains;
+	std::shared_ptr<vif_chain_cache> _vif_chains;
 };
 
 #endif
@@ -0,0 +1,239 @@
+/*
+	wrench - A set of modding tools for the Ratchet & Clank PS2 games.
+	Copyright (C) 2019-2020 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "quantiser.h"
+
+#include <array>
+#include <memory>
+#include <optional>
+#include <algorithm>
+#include <unordered_map>
+
+static const std::size_t MAX_COLOURS = 256;
+static const std::size_t NUM_BINS = 1 << 15;
+
+static uint16_t bin_of(int r, int g, int b) {
+	return ((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3);
+}
+
+static std::optional<quantised_image> quantise_exact(const std::vector<colour>& pixels) {
+	quantised_image result;
+	result.indices.resize(pixels.size());
+	std::unordered_map<uint32_t, uint8_t> indices;
+	for(std::size_t i = 0; i < pixels.size(); i++) {
+		const colour& c = pixels[i];
+		uint32_t key = (c.r << 16) | (c.g << 8) | c.b;
+		auto iter = indices.find(key);
+		if(iter == indices.end()) {
+			if(result.palette.size() == MAX_COLOURS) {
+				return {};
+			}
+			iter = indices.emplace(key, result.palette.size()).first;
+			result.palette.push_back({ c.r, c.g, c.b, 0x80 });
+		}
+		result.indices[i] = iter->second;
+	}
+	return result;
+}
+
+struct histogram_bin {
+	uint16_t key;
+	uint64_t count;
+	uint64_t sum[3];
+
+	int channel(int axis) const {
+		return (key >> (10 - axis * 5)) & 0x1f;
+	}
+};
+
+// A contiguous range of the bins array.
+struct colour_box {
+	std::size_t begin;
+	std::size_t end;
+	uint64_t population;
+	int longest_axis;
+	int extent;
+};
+
+static colour_box make_box(const std::vector<histogram_bin>& bins, std::size_t begin, std::size_t end) {
+	colour_box box { begin, end, 0, 0, 0 };
+	int min[3] = { 31, 31, 31 };
+	int max[3] = { 0, 0, 0 };
+	for(std::size_t i = begin; i < end; i++) {
+		box.population += bins[i].count;
+		for(int axis = 0; axis < 3; axis++) {
+			min[axis] = std::min(min[axis], bins[i].channel(axis));
+			max[axis] = std::max(max[axis], bins[i].channel(axis));
+		}
+	}
+	for(int axis = 0; axis < 3; axis++) {
+		if(max[axis] - min[axis] > box.extent) {
+			box.extent = max[axis] - min[axis];
+			box.longest_axis = axis;
+		}
+	}
+	return box;
+}
+
+static std::vector<colour> median_cut(std::vector<histogram_bin>& bins) {
+	std::vector<colour_box> boxes { make_box(bins, 0, bins.size()) };
+	while(boxes.size() < MAX_COLOURS) {
+		// Split the box with the most pixels times its longest side.
+		auto box_iter = std::max_element(boxes.begin(), boxes.end(),
+			[](const colour_box& lhs, const colour_box& rhs) {
+				return lhs.population * lhs.extent < rhs.population * rhs.extent;
+			});
+		if(box_iter->extent == 0) {
+			break; // Every box contains a single bin.
+		}
+		colour_box box = *box_iter;
+
+		int axis = box.longest_axis;
+		std::sort(bins.begin() + box.begin, bins.begin() + box.end,
+			[&](const histogram_bin& lhs, const histogram_bin& rhs) { return lhs.channel(axis) < rhs.channel(axis); });
+
+		// Split at the weighted median, keeping both halves non-empty.
+		std::size_t split = box.begin + 1;
+		uint64_t below = bins[box.begin].count;
+		while(split < box.end - 1 && below * 2 < box.population) {
+			below += bins[split++].count;
+		}
+
+		*box_iter = make_box(bins, box.begin, split);
+		boxes.push_back(make_box(bins, split, box.end));
+	}
+
+	std::vector<colour> palette;
+	for(colour_box& box : boxes) {
+		uint64_t sum[3] = { 0, 0, 0 };
+		for(std::size_t i = box.begin; i < box.end; i++) {
+			for(int axis = 0; axis < 3; axis++) {
+				sum[axis] += bins[i].sum[axis];
+			}
+		}
+		palette.push_back({
+			(uint8_t) ((sum[0] + box.population / 2) / box.population),
+			(uint8_t) ((sum[1] + box.population / 2) / box.population),
+			(uint8_t) ((sum[2] + box.population / 2) / box.population),
+			0x80
+		});
+	}
+	return palette;
+}
+
+// Finds the closest palette entry to each colour, caching the result per
+// histogram bin since neighbouring colours almost always agree.
+class nearest_colour_finder {
+public:
+	nearest_colour_finder(const std::vector<colour>& palette) : _size(palette.size()) {
+		for(std::size_t i = 0; i < _size; i++) {
+			_r[i] = palette[i].r;
+			_g[i] = palette[i].g;
+			_b[i] = palette[i].b;
+		}
+		_cache.fill(-1);
+	}
+
+	uint8_t find(int r, int g, int b) {
+		int16_t& cached = _cache[bin_of(r, g, b)];
+		if(cached == -1) {
+			cached = search(r | 4, g | 4, b | 4);
+		}
+		return (uint8_t) cached;
+	}
+
+private:
+	uint8_t search(int r, int g, int b) const {
+		// The palette is stored as separate channel arrays so that this loop
+		// can be vectorised by the compiler.
+		std::array<int32_t, MAX_COLOURS> distances;
+		for(std::size_t i = 0; i < _size; i++) {
+			int32_t dr = _r[i] - r;
+			int32_t dg = _g[i] - g;
+			int32_t db = _b[i] - b;
+			distances[i] = dr * dr + dg * dg + db * db;
+		}
+		return (uint8_t) (std::min_element(distances.begin(), distances.begin() + _size) - distances.begin());
+	}
+
+	std::size_t _size;
+	std::array<int32_t, MAX_COLOURS> _r, _g, _b;
+	std::array<int16_t, NUM_BINS> _cache;
+};
+
+quantised_image quantise(const std::vector<colour>& pixels, std::size_t width, std::size_t height, bool dither) {
+	if(std::optional<quantised_image> exact = quantise_exact(pixels)) {
+		return *exact;
+	}
+
+	std::vector<histogram_bin> all_bins(NUM_BINS);
+	for(const colour& c : pixels) {
+		histogram_bin& bin = all_bins[bin_of(c.r, c.g, c.b)];
+		bin.count++;
+		bin.sum[0] += c.r;
+		bin.sum[1] += c.g;
+		bin.sum[2] += c.b;
+	}
+	std::vector<histogram_bin> bins;
+	for(std::size_t i = 0; i < NUM_BINS; i++) {
+		if(all_bins[i].count > 0) {
+			all_bins[i].key = i;
+			bins.push_back(all_bins[i]);
+		}
+	}
+
+	quantised_image result;
+	result.palette = median_cut(bins);
+	result.indices.resize(pixels.size());
+
+	auto finder = std::make_unique<nearest_colour_finder>(result.palette);
+	if(!dither) {
+		for(std::size_t i = 0; i < pixels.size(); i++) {
+			result.indices[i] = finder->find(pixels[i].r, pixels[i].g, pixels[i].b);
+		}
+		return result;
+	}
+
+	// Floyd-Steinberg. Errors for the current and next rows, with a pixel of
+	// padding on either side.
+	std::vector<std::array<int, 3>> error(width + 2), next_error(width + 2);
+	for(std::size_t y = 0; y < height; y++) {
+		std::fill(next_error.begin(), next_error.end(), std::array<int, 3> { 0, 0, 0 });
+		for(std::size_t x = 0; x < width; x++) {
+			const colour& c = pixels[y * width + x];
+			int value[3] = { c.r, c.g, c.b };
+			for(int axis = 0; axis < 3; axis++) {
+				value[axis] = std::clamp(value[axis] + error[x + 1][axis] / 16, 0, 255);
+			}
+			uint8_t index = finder->find(value[0], value[1], value[2]);
+			result.indices[y * width + x] = index;
+
+			const colour& chosen = result.palette[index];
+			int chosen_value[3] = { chosen.r, chosen.g, chosen.b };
+			for(int axis = 0; axis < 3; axis++) {
+				int diff = value[axis] - chosen_value[axis];
+				error[x + 2][axis] += diff * 7;
+				next_error[x][axis] += diff * 3;
+				next_error[x + 1][axis] += diff * 5;
+				next_error[x + 2][axis] += diff;
+			}
+		}
+		std::swap(error, next_error);
+	}
+	return result;
+}
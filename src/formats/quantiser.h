@@ -0,0 +1,43 @@
+/*
+	wrench - A set of modding tools for the Ratchet & Clank PS2 games.
+	Copyright (C) 2019-2020 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef FORMATS_QUANTISER_H
+#define FORMATS_QUANTISER_H
+
+#include <vector>
+#include <stdint.h>
+
+#include "texture.h"
+
+# /*
+#	Reduce truecolour images to 256 colours so they can be imported as
+#	indexed textures. Uses median cut over a 15-bit colour histogram, so the
+#	cost is mostly linear in the number of pixels.
+# */
+
+struct quantised_image {
+	std::vector<colour> palette; // At most 256 entries. Alpha is always 0x80.
+	std::vector<uint8_t> indices;
+};
+
+// Images with at most 256 distinct colours are converted exactly. Otherwise
+// a palette is generated, optionally with Floyd-Steinberg dithering. The
+// alpha channel of the input is ignored.
+quantised_image quantise(const std::vector<colour>& pixels, std::size_t width, std::size_t height, bool dither);
+
+#endif
@@ -45,9 +45,11 @@ racpak_entry racpak::entry(std::size_t index) {
 }
 
 stream* racpak::open(racpak_entry entry) {
-	_open_segments.emplace_back(
-		std::make_unique<proxy_stream>(&_backing, entry.offset, entry.size));
-	return _open_segments.back().get();
+	auto& segment = _open_segments[{ entry.offset, entry.size }];
+	if(segment.get() == nullptr) {
+		segment = std::make_unique<proxy_stream>(&_backing, entry.offset, entry.size);
+	}
+	return segment.get();
 }
 
 bool racpak::is_compressed(racpak_entry entry) {
@@ -19,6 +19,7 @@
 #ifndef FORMATS_RACPAK_H
 #define FORMATS_RACPAK_H
 
+#include <map>
 #include <vector>
 
 #include "../stream.h"
@@ -41,13 +42,16 @@ public:
 	std::size_t num_entries();
 	std::size_t base();
 	racpak_entry entry(std::size_t index);
+	// Returns a stream that stays valid for the lifetime of the racpak.
+	// Opening the same entry more than once returns the same stream.
 	stream* open(racpak_entry file);
 	bool is_compressed(racpak_entry entry);
 
 private:
 	proxy_stream _backing;
 	std::size_t _base;
-	std::vector<std::unique_ptr<proxy_stream>> _open_segments;
+	// Indexed by { offset, size }.
+	std::map<std::pair<std::size_t, std::size_t>, std::unique_ptr<proxy_stream>> _open_segments;
 };
 
 #endif
@@ -18,30 +18,23 @@
 
 #include "texture.h"
 
-#include "../util.h" // int_to_hex
+#include "../util.h" // int_to_hex, content_hasher
 #include "fip.h" // decode_palette_index
 
 texture::texture(stream* backing, std::size_t pixel_data_offset, std::size_t palette_offset, vec2i size)
-	: _backing(backing), _pixel_data_offset(pixel_data_offset), _palette_offset(palette_offset), _size(size) {}
+	: _backing(backing),
+	  _pixel_data_offset(pixel_data_offset),
+	  _palette_offset(palette_offset),
+	  _size(size),
+	  _cache(std::make_shared<decode_cache>()) {}
 
 vec2i texture::size() const {
 	return _size;
 }
 
 std::array<colour, 256> texture::palette() const {
-	char data[1024];
-	_backing->peek_n(data, _palette_offset, 1024);
-
-	std::array<colour, 256> result;
-	for(int i = 0; i < 256; i++) {
-		result[decode_palette_index(i)] = {
-			static_cast<uint8_t>(data[i * 4 + 0]),
-			static_cast<uint8_t>(data[i * 4 + 1]),
-			static_cast<uint8_t>(data[i * 4 + 2]),
-			static_cast<uint8_t>(data[i * 4 + 3])
-		};
-	}
-	return result;
+	std::lock_guard<std::mutex> lock(_cache->mutex);
+	return cached_palette(*_cache);
 }
 
 void texture::set_palette(std::array<colour, 256> palette_) {
@@ -55,18 +48,39 @@ void texture::set_palette(std::array<colour, 256> palette_) {
 	}
 	_backing->seek(_palette_offset);
 	_backing->write_n(colours.data(), colours.size());
+	
+	std::lock_guard<std::mutex> lock(_cache->mutex);
+	_cache->palette = palette_;
+	_cache->rgba = nullptr;
 }
 
 std::vector<uint8_t> texture::pixel_data() const {
-	vec2i size_ = size();
-	std::vector<uint8_t> result(size_.x * size_.y);
-	_backing->peek_n(reinterpret_cast<char*>(result.data()), _pixel_data_offset, result.size());
-	return result;
+	std::lock_guard<std::mutex> lock(_cache->mutex);
+	return *cached_pixel_data(*_cache);
 }
 
 void texture::set_pixel_data(std::vector<uint8_t> pixel_data_) {
 	_backing->seek(_pixel_data_offset);
 	_backing->write_n(reinterpret_cast<char*>(pixel_data_.data()), pixel_data_.size());
+	
+	std::lock_guard<std::mutex> lock(_cache->mutex);
+	_cache->pixel_data = nullptr;
+	_cache->rgba = nullptr;
+}
+
+std::shared_ptr<const std::vector<colour>> texture::rgba() const {
+	std::lock_guard<std::mutex> lock(_cache->mutex);
+	if(!_cache->rgba) {
+		_cache->rgba = std::make_shared<const std::vector<colour>>(
+			expand_indexed_pixels(cached_palette(*_cache), *cached_pixel_data(*_cache)));
+	}
+	return _cache->rgba;
+}
+
+void texture::drop_decoded_data() const {
+	std::lock_guard<std::mutex> lock(_cache->mutex);
+	_cache->pixel_data = nullptr;
+	_cache->rgba = nullptr;
 }
 
 std::string texture::palette_path() const {
@@ -77,6 +91,84 @@ std::string texture::pixel_data_path() const {
 	return _backing->resource_path() + "+0x" + int_to_hex(_pixel_data_offset);
 }
 
+content_hash texture::hash() const {
+	std::lock_guard<std::mutex> lock(_cache->mutex);
+	std::array<colour, 256> palette = cached_palette(*_cache);
+	
+	content_hasher hasher;
+	hasher.update(&_size, sizeof(vec2i));
+	hasher.update(palette.data(), sizeof(palette));
+	if(_cache->pixel_data) {
+		hasher.update(_cache->pixel_data->data(), _cache->pixel_data->size());
+	} else {
+		std::vector<uint8_t> pixels(_size.x * _size.y);
+		_backing->peek_n(reinterpret_cast<char*>(pixels.data()), _pixel_data_offset, pixels.size());
+		hasher.update(pixels.data(), pixels.size());
+	}
+	return hasher.digest();
+}
+
+stream* texture::backing() const {
+	return _backing;
+}
+
+std::shared_ptr<const std::vector<uint8_t>> texture::cached_pixel_data(decode_cache& cache) const {
+	if(!cache.pixel_data) {
+		auto result = std::make_shared<std::vector<uint8_t>>(_size.x * _size.y);
+		_backing->peek_n(reinterpret_cast<char*>(result->data()), _pixel_data_offset, result->size());
+		cache.pixel_data = result;
+	}
+	return cache.pixel_data;
+}
+
+std::array<colour, 256> texture::cached_palette(decode_cache& cache) const {
+	if(!cache.palette) {
+		char data[1024];
+		_backing->peek_n(data, _palette_offset, 1024);
+		
+		std::array<colour, 256> result;
+		for(int i = 0; i < 256; i++) {
+			result[decode_palette_index(i)] = {
+				static_cast<uint8_t>(data[i * 4 + 0]),
+				static_cast<uint8_t>(data[i * 4 + 1]),
+				static_cast<uint8_t>(data[i * 4 + 2]),
+				static_cast<uint8_t>(data[i * 4 + 3])
+			};
+		}
+		cache.palette = result;
+	}
+	return *cache.palette;
+}
+
+std::vector<colour> expand_indexed_pixels(const std::array<colour, 256>& palette, const std::vector<uint8_t>& indices) {
+	// Scale the alpha channel once per palette entry rather than per pixel,
+	// so that expanding each pixel is a single 32-bit table lookup.
+	std::array<colour, 256> lut = palette;
+	for(colour& c : lut) {
+		c.a = static_cast<uint8_t>(static_cast<int>(c.a) * 2 - 1);
+	}
+	
+	std::vector<colour> result(indices.size());
+	const uint8_t* src = indices.data();
+	colour* dest = result.data();
+	std::size_t count = indices.size();
+	std::size_t i = 0;
+	for(; i + 8 <= count; i += 8) {
+		dest[i + 0] = lut[src[i + 0]];
+		dest[i + 1] = lut[src[i + 1]];
+		dest[i + 2] = lut[src[i + 2]];
+		dest[i + 3] = lut[src[i + 3]];
+		dest[i + 4] = lut[src[i + 4]];
+		dest[i + 5] = lut[src[i + 5]];
+		dest[i + 6] = lut[src[i + 6]];
+		dest[i + 7] = lut[src[i + 7]];
+	}
+	for(; i < count; i++) {
+		dest[i] = lut[src[i]];
+	}
+	return result;
+}
+
 std::optional<texture> create_fip_texture(stream* backing, std::size_t offset) {
 	fip_header header = backing->peek<fip_header>(offset);
 	if(!validate_fip(header.magic)) {
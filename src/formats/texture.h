@@ -20,10 +20,14 @@
 #define FORMATS_TEXTURE_H
 
 #include <array>
+#include <mutex>
+#include <memory>
 #include <vector>
+#include <optional>
 #include <stdint.h>
 #include <glm/glm.hpp>
 
+#include "../util.h"
 #include "../stream.h"
 
 # /*
@@ -54,18 +58,51 @@ public:
 	std::vector<uint8_t> pixel_data() const;
 	void set_pixel_data(std::vector<uint8_t> pixel_data_);
 
+	// One colour per pixel, with alpha scaled up from the PS2's 0-128 range.
+	// Anything that wants to display the texture should use this rather than
+	// expanding the palette itself.
+	std::shared_ptr<const std::vector<colour>> rgba() const;
+	
+	// Drop the cached pixel data and RGBA data, e.g. once the texture has
+	// been uploaded to the GPU, so they don't stay in memory for as long as
+	// the texture does. They're read again from the stream when next needed.
+	void drop_decoded_data() const;
+
 	std::string palette_path() const;
 	std::string pixel_data_path() const;
 	
+	// Of the size, palette and pixel data, so byte-identical textures stored
+	// in different places hash the same. Doesn't keep the pixel data around.
+	content_hash hash() const;
+	
+	// The stream that set_palette and set_pixel_data write to.
+	stream* backing() const;
+	
 	std::string name;
 	
 private:
+	// Shared between copies of the same texture, and cleared when either of
+	// the setters is called.
+	struct decode_cache {
+		std::mutex mutex;
+		std::optional<std::array<colour, 256>> palette;
+		std::shared_ptr<const std::vector<uint8_t>> pixel_data;
+		std::shared_ptr<const std::vector<colour>> rgba;
+	};
+
+	std::shared_ptr<const std::vector<uint8_t>> cached_pixel_data(decode_cache& cache) const;
+	std::array<colour, 256> cached_palette(decode_cache& cache) const;
+
 	stream* _backing;
 	std::size_t _pixel_data_offset;
 	std::size_t _palette_offset;
 	vec2i _size;
+	std::shared_ptr<decode_cache> _cache;
 };
 
+// One colour per pixel, with alpha scaled up from the PS2's 0-128 range.
+std::vector<colour> expand_indexed_pixels(const std::array<colour, 256>& palette, const std::vector<uint8_t>& indices);
+
 // Won't affect the position indicator of backing.
 std::optional<texture> create_fip_texture(stream* backing, std::size_t offset);
 
@@ -20,15 +20,39 @@
 
 #include "../util.h"
 #include "fip.h"
+#include "classifier.h"
 #include "level_impl.h"
 
-std::vector<texture> enumerate_fip_textures(iso_stream* iso, racpak* archive) {	
+// Used for archive entries the catalogue doesn't know about.
+static std::optional<std::size_t> find_fip_header(stream* file) {
+	char header[0x14];
+	file->seek(0);
+	file->read_n(header, 0x14);
+	
+	static const content_classifier classifier = default_classifier({ "fip" });
+	for(const content_match& match : classifier.classify_at(header, 0x14)) {
+		return match.offset;
+	}
+	return {};
+}
+
+std::vector<texture> enumerate_fip_textures(iso_stream* iso, racpak* archive, const disc_catalogue& catalogue) {	
 	std::vector<texture> textures;
 	
+	std::size_t num_uncatalogued = 0;
 	for(std::size_t i = 0; i < archive->num_entries(); i++) {
 		auto entry = archive->entry(i);
+		
+		// Skip entries that the catalogue lists as something other than a
+		// texture so we don't have to decompress them to find out.
+		const catalogue_object* object = catalogue.find(archive->base() + entry.offset);
+		if(object != nullptr && object->type != "fip") {
+			continue;
+		}
+		
+		bool compressed = object != nullptr ? object->compressed : archive->is_compressed(entry);
 		stream* file;
-		if(archive->is_compressed(entry)) {
+		if(compressed) {
 			file = iso->get_decompressed(archive->base() + entry.offset);
 		} else {
 			file = archive->open(entry);
@@ -38,28 +62,33 @@ std::vector<texture> enumerate_fip_textures(iso_stream* iso, racpak* archive) {
 			continue;
 		}
 		
-		char magic[0x14];
-		file->seek(0);
-		file->read_n(magic, 0x14);
-		
-		std::optional<std::size_t> texture_offset;
-		if(validate_fip(magic)) {
-			texture_offset = 0;
-		}
-		if(validate_fip(magic + 0x10)) {
-			texture_offset = 0x10;
+		std::optional<std::size_t> header_offset;
+		if(object != nullptr) {
+			header_offset = object->header_offset;
+		} else {
+			num_uncatalogued++;
+			header_offset = find_fip_header(file);
+			if(!header_offset) {
+				continue;
+			}
 		}
 		
-		if(texture_offset) {
-			std::optional<texture> tex = create_fip_texture(file, *texture_offset);
-			if(tex) {
-				textures.emplace_back(*tex);
-			} else {
-				std::cerr << "Error: Failed to load 2FIP texture at "
-				          << file->resource_path() << "\n";
-			}
+		std::optional<texture> tex = create_fip_texture(file, *header_offset);
+		if(tex) {
+			textures.emplace_back(*tex);
+		} else {
+			std::cerr << "Error: Failed to load 2FIP texture at "
+			          << file->resource_path() << "\n";
 		}
 	}
 	
+	if(num_uncatalogued > 0) {
+		std::cerr << "Warning: " << num_uncatalogued << " of " << archive->num_entries()
+		          << " entries in the archive at 0x" << std::hex << archive->base() << std::dec
+		          << " weren't in the disc catalogue, so they were checked directly."
+		          << (catalogue.objects.empty() ? " The catalogue is empty." : " The catalogue may be stale.")
+		          << "\n";
+	}
+	
 	return textures;
 }
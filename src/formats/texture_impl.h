@@ -25,6 +25,7 @@
 
 #include "../stream.h"
 #include "../worker_logger.h"
+#include "../disc_catalogue.h"
 #include "wad.h"
 #include "racpak.h"
 #include "texture.h"
@@ -60,6 +61,6 @@ private:
 	std::string _display_name;
 };
 
-std::vector<texture> enumerate_fip_textures(iso_stream* iso, racpak* archive);
+std::vector<texture> enumerate_fip_textures(iso_stream* iso, racpak* archive, const disc_catalogue& catalogue);
 
 #endif
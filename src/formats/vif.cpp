@@ -18,79 +18,133 @@
 
 #include "vif.h"
 
+#include <array>
 #include <sstream>
+#include <algorithm>
 
 #include "../util.h"
 
+// Everything about a VIF code that only depends on its top byte (the command
+// and interrupt bit), so parsing doesn't have to work it out every time.
+struct vif_code_info {
+	enum size_formula : uint8_t {
+		INVALID,
+		FIXED, // size words.
+		MPG, // 1 + num * 2 words.
+		DIRECT, // 1 + immediate * 4 words.
+		UNPACK // 1 + (num * size) / 4 words, where size is in bytes.
+	};
+	enum immediate_layout : uint8_t {
+		NONE,
+		FIELD, // A single field, (val >> field_lo) & field_mask.
+		STCYCL,
+		UNPACK_FIELDS
+	};
+	size_formula formula = INVALID;
+	uint8_t size = 0;
+	immediate_layout layout = NONE;
+	uint8_t field_lo = 0;
+	uint32_t field_mask = 0;
+	uint32_t field_if_zero = 0; // e.g. a DIRECT size of 0 means 65536.
+};
+
+static constexpr std::array<vif_code_info, 256> make_vif_code_table() {
+	using info_t = vif_code_info;
+	std::array<vif_code_info, 256> table {};
+	for(int byte = 0; byte < 256; byte++) {
+		vif_code_info& info = table[byte];
+		switch(static_cast<vif_cmd>(byte & 0x7f)) {
+			case vif_cmd::NOP:
+			case vif_cmd::FLUSHE:
+			case vif_cmd::FLUSH:
+			case vif_cmd::FLUSHA:
+			case vif_cmd::MSCNT:
+				info = { info_t::FIXED, 1, info_t::NONE };
+				break;
+			case vif_cmd::STCYCL:
+				info = { info_t::FIXED, 1, info_t::STCYCL };
+				break;
+			case vif_cmd::OFFSET:
+			case vif_cmd::BASE:
+			case vif_cmd::ITOP:
+				info = { info_t::FIXED, 1, info_t::FIELD, 0, 0x3ff };
+				break;
+			case vif_cmd::STMOD:
+				info = { info_t::FIXED, 1, info_t::FIELD, 0, 0b11 };
+				break;
+			case vif_cmd::MSKPATH3:
+				info = { info_t::FIXED, 1, info_t::FIELD, 15, 1 };
+				break;
+			case vif_cmd::MARK:
+			case vif_cmd::MSCAL:
+			case vif_cmd::MSCALF:
+				info = { info_t::FIXED, 1, info_t::FIELD, 0, 0xffff };
+				break;
+			case vif_cmd::STMASK:
+				info = { info_t::FIXED, 2, info_t::NONE };
+				break;
+			case vif_cmd::STROW:
+			case vif_cmd::STCOL:
+				info = { info_t::FIXED, 5, info_t::NONE };
+				break;
+			case vif_cmd::MPG:
+				info = { info_t::MPG, 0, info_t::FIELD, 0, 0xffff };
+				break;
+			case vif_cmd::DIRECT:
+			case vif_cmd::DIRECTHL:
+				info = { info_t::DIRECT, 0, info_t::FIELD, 0, 0xffff, 65536 };
+				break;
+			default:
+				if((byte & 0b1100000) == 0b1100000) {
+					int vn = (byte >> 2) & 0b11;
+					int vl = byte & 0b11;
+					// This is what PCSX2 does when wl <= cl.
+					// Assume wl = cl = 4.
+					int gsize = ((32 >> vl) * (vn + 1)) / 8;
+					info = { info_t::UNPACK, static_cast<uint8_t>(gsize), info_t::UNPACK_FIELDS };
+				}
+		}
+	}
+	return table;
+}
+
+static constexpr std::array<vif_code_info, 256> VIF_CODE_TABLE = make_vif_code_table();
+
 std::optional<vif_code> vif_code::parse(uint32_t val) {
+	const vif_code_info& info = VIF_CODE_TABLE[val >> 24];
+	if(info.formula == vif_code_info::INVALID) {
+		return {};
+	}
+	
 	vif_code code;
-	code.interrupt = bit_range(val, 31, 31);
+	code.interrupt = val >> 31;
 	code.cmd       = static_cast<vif_cmd>(bit_range(val, 24, 30));
 	code.num       = bit_range(val, 16, 23);
 	code.num = code.num ? code.num : 256;
 	
-	switch(code.cmd) {
-		case vif_cmd::NOP:
+	switch(info.layout) {
+		case vif_code_info::NONE:
 			break;
-		case vif_cmd::STCYCL:
+		case vif_code_info::FIELD: {
+			// Every single field member of the union is a struct starting with
+			// an int, so they can all be written through offset.offset.
+			uint32_t field = (val >> info.field_lo) & info.field_mask;
+			code.offset.offset = field ? field : info.field_if_zero;
+			break;
+		}
+		case vif_code_info::STCYCL:
 			code.stcycl.wl = bit_range(val, 8, 15);
 			code.stcycl.cl = bit_range(val, 0, 7);
 			break;
-		case vif_cmd::OFFSET:
-			code.offset.offset = bit_range(val, 0, 9);
-			break;
-		case vif_cmd::BASE:
-			code.base.base = bit_range(val, 0, 9);
-			break;
-		case vif_cmd::ITOP:
-			code.itop.addr = bit_range(val, 0, 9);
-			break;
-		case vif_cmd::STMOD:
-			code.stmod.mode = bit_range(val, 0, 1);
-			break;
-		case vif_cmd::MSKPATH3:
-			code.mskpath3.mask = bit_range(val, 15, 15);
-			break;
-		case vif_cmd::MARK:
-			code.mark.mark = bit_range(val, 0, 15);
-			break;
-		case vif_cmd::FLUSHE:
-		case vif_cmd::FLUSH:
-		case vif_cmd::FLUSHA:
-			break;
-		case vif_cmd::MSCAL:
-			code.mscal.execaddr = bit_range(val, 0, 15);
-			break;
-		case vif_cmd::MSCNT:
-			break;
-		case vif_cmd::MSCALF:
-			code.mscalf.execaddr = bit_range(val, 0, 15);
-			break;
-		case vif_cmd::STMASK:
-		case vif_cmd::STROW:
-		case vif_cmd::STCOL:
-			break;
-		case vif_cmd::MPG:
-			code.mpg.loadaddr = bit_range(val, 0, 15);
-			break;
-		case vif_cmd::DIRECT:
-			code.direct.size = bit_range(val, 0, 15);
-			code.direct.size = code.direct.size ? code.direct.size : 65536;
-			break;
-		case vif_cmd::DIRECTHL:
-			code.directhl.size = bit_range(val, 0, 15);
-			code.directhl.size = code.directhl.size ? code.directhl.size : 65536;
-			break;
-		default:
-			if(!code.is_unpack()) {
-				return {};
-			}
+		case vif_code_info::UNPACK_FIELDS:
+			// Every value of these fields is valid, so there's nothing to check.
 			code.unpack.vn = bit_range(val, 26, 27);
 			code.unpack.vl = bit_range(val, 24, 25);
-			code.unpack.vnvl = vif_vnvl ::_from_integral(bit_range(val, 24, 27));
-			code.unpack.flg  = vif_flg::_from_integral(bit_range(val, 15, 15));
-			code.unpack.usn  = vif_usn::_from_integral(bit_range(val, 14, 14));
+			code.unpack.vnvl = vif_vnvl::_from_integral_unchecked(bit_range(val, 24, 27));
+			code.unpack.flg  = vif_flg::_from_integral_unchecked(bit_range(val, 15, 15));
+			code.unpack.usn  = vif_usn::_from_integral_unchecked(bit_range(val, 14, 14));
 			code.unpack.addr = bit_range(val, 0, 9);
+			break;
 	}
 	
 	return code;
@@ -101,47 +155,27 @@ bool vif_code::is_unpack() const {
 }
 
 std::size_t vif_code::packet_size() const {
+	return packet_size(1, 1);
+}
+
+std::size_t vif_code::packet_size(int wl, int cl) const {
+	const vif_code_info& info = VIF_CODE_TABLE[static_cast<int>(cmd) & 0x7f];
 	std::size_t result = 0;
-	switch(cmd) {
-		case vif_cmd::NOP:
-		case vif_cmd::STCYCL:
-		case vif_cmd::OFFSET:
-		case vif_cmd::BASE:
-		case vif_cmd::ITOP:
-		case vif_cmd::STMOD:
-		case vif_cmd::MSKPATH3:
-		case vif_cmd::MARK:
-		case vif_cmd::FLUSHE:
-		case vif_cmd::FLUSH:
-		case vif_cmd::FLUSHA:
-		case vif_cmd::MSCAL:
-		case vif_cmd::MSCNT:
-		case vif_cmd::MSCALF:
-			result = 1;
+	switch(info.formula) {
+		case vif_code_info::INVALID:
 			break;
-		case vif_cmd::STMASK:
-			result = 2;
+		case vif_code_info::FIXED:
+			result = info.size;
 			break;
-		case vif_cmd::STROW:
-		case vif_cmd::STCOL:
-			result = 5;
-			break;
-		case vif_cmd::MPG:
+		case vif_code_info::MPG:
 			result = 1 + num * 2;
 			break;
-		case vif_cmd::DIRECT:
-			result = 1 + direct.size * 4;
+		case vif_code_info::DIRECT:
+			result = 1 + (cmd == vif_cmd::DIRECT ? direct.size : directhl.size) * 4;
 			break;
-		case vif_cmd::DIRECTHL:
-			result = 1 + directhl.size * 4;
+		case vif_code_info::UNPACK:
+			result = 1 + (unpack_num_inputs(wl, cl) * info.size) / 4;
 			break;
-		default:
-			if(is_unpack()) {
-				// This is what PCSX2 does when wl <= cl.
-				// Assume wl = cl = 4.
-				int gsize = ((32 >> unpack.vl) * (unpack.vn + 1)) / 8;
-				result = 1 + (num * gsize) / 4;
-			}
 	}
 	
 	if(result == 0) {
@@ -151,40 +185,72 @@ std::size_t vif_code::packet_size() const {
 	return result * 4;
 }
 
+std::size_t vif_code::unpack_num_inputs(int wl, int cl) const {
+	if(wl <= cl || wl == 0) {
+		return num;
+	}
+	// Only the first CL qwords of each cycle of WL come from the input data.
+	std::size_t n = num;
+	return (n / wl) * cl + std::min<std::size_t>(n % wl, cl);
+}
+
+const char* vif_cmd_name(vif_cmd cmd) {
+	switch(cmd) {
+		case vif_cmd::NOP:      return "NOP";
+		case vif_cmd::STCYCL:   return "STCYCL";
+		case vif_cmd::OFFSET:   return "OFFSET";
+		case vif_cmd::BASE:     return "BASE";
+		case vif_cmd::ITOP:     return "ITOP";
+		case vif_cmd::STMOD:    return "STMOD";
+		case vif_cmd::MSKPATH3: return "MSKPATH3";
+		case vif_cmd::MARK:     return "MARK";
+		case vif_cmd::FLUSHE:   return "FLUSHE";
+		case vif_cmd::FLUSH:    return "FLUSH";
+		case vif_cmd::FLUSHA:   return "FLUSHA";
+		case vif_cmd::MSCAL:    return "MSCAL";
+		case vif_cmd::MSCNT:    return "MSCNT";
+		case vif_cmd::MSCALF:   return "MSCALF";
+		case vif_cmd::STMASK:   return "STMASK";
+		case vif_cmd::STROW:    return "STROW";
+		case vif_cmd::STCOL:    return "STCOL";
+		case vif_cmd::MPG:      return "MPG";
+		case vif_cmd::DIRECT:   return "DIRECT";
+		case vif_cmd::DIRECTHL: return "DIRECTHL";
+		default:
+			return (static_cast<int>(cmd) & 0b1100000) == 0b1100000 ? "UNPACK" : nullptr;
+	}
+}
+
 std::string vif_code::to_string() const {
+	const char* name = vif_cmd_name(cmd);
+	if(name == nullptr) {
+		return "INVALID VIF CODE";
+	}
+	
 	std::stringstream ss;
 	ss << std::hex;
-	ss << "vif_code cmd=";
+	ss << "vif_code cmd=" << name;
 	switch(cmd) {
-		case vif_cmd::NOP:      ss << "NOP"; break;
-		case vif_cmd::STCYCL:   ss << "STCYCL num=" << num << " wl=" << stcycl.wl << " cl=" << stcycl.cl; break;
-		case vif_cmd::OFFSET:   ss << "OFFSET offset=" << offset.offset; break;
-		case vif_cmd::BASE:     ss << "BASE base=" << base.base; break;
-		case vif_cmd::ITOP:     ss << "ITOP addr=" << itop.addr; break;
-		case vif_cmd::STMOD:    ss << "STMOD mode=" << stmod.mode; break;
-		case vif_cmd::MSKPATH3: ss << "MSKPATH3 mask=" << mskpath3.mask; break;
-		case vif_cmd::MARK:     ss << "MARK mark=" << mark.mark; break;
-		case vif_cmd::FLUSHE:   ss << "FLUSHE"; break;
-		case vif_cmd::FLUSH:    ss << "FLUSH"; break;
-		case vif_cmd::FLUSHA:   ss << "FLUSHA"; break;
-		case vif_cmd::MSCAL:    ss << "MSCAL execaddr=" << mscal.execaddr; break;
-		case vif_cmd::MSCNT:    ss << "MSCNT"; break;
-		case vif_cmd::MSCALF:   ss << "MSCALF execaddr=" << mscalf.execaddr; break;
-		case vif_cmd::STMASK:   ss << "STMASK"; break;
-		case vif_cmd::STROW:    ss << "STROW"; break;
-		case vif_cmd::STCOL:    ss << "STCOL"; break;
-		case vif_cmd::MPG:      ss << "MPG num=" << num << " loadaddr=" << mpg.loadaddr; break;
-		case vif_cmd::DIRECT:   ss << "DIRECT size=" << direct.size; break;
-		case vif_cmd::DIRECTHL: ss << "DIRECTHL size=" << directhl.size; break;
+		case vif_cmd::STCYCL:   ss << " num=" << num << " wl=" << stcycl.wl << " cl=" << stcycl.cl; break;
+		case vif_cmd::OFFSET:   ss << " offset=" << offset.offset; break;
+		case vif_cmd::BASE:     ss << " base=" << base.base; break;
+		case vif_cmd::ITOP:     ss << " addr=" << itop.addr; break;
+		case vif_cmd::STMOD:    ss << " mode=" << stmod.mode; break;
+		case vif_cmd::MSKPATH3: ss << " mask=" << mskpath3.mask; break;
+		case vif_cmd::MARK:     ss << " mark=" << mark.mark; break;
+		case vif_cmd::MSCAL:    ss << " execaddr=" << mscal.execaddr; break;
+		case vif_cmd::MSCALF:   ss << " execaddr=" << mscalf.execaddr; break;
+		case vif_cmd::MPG:      ss << " num=" << num << " loadaddr=" << mpg.loadaddr; break;
+		case vif_cmd::DIRECT:   ss << " size=" << direct.size; break;
+		case vif_cmd::DIRECTHL: ss << " size=" << directhl.size; break;
 		default:
-			if(!is_unpack()) {
-				return "INVALID VIF CODE";
+			if(is_unpack()) {
+				ss << " vnvl=" << unpack.vnvl
+				   << " num=" << num
+				   << " flg=" << unpack.flg
+				   << " usn=" << unpack.usn 
+				   << " addr=" << unpack.addr;
 			}
-			ss << "UNPACK vnvl=" << unpack.vnvl
-			   << " num=" << num
-			   << " flg=" << unpack.flg
-			   << " usn=" << unpack.usn 
-			   << " addr=" << unpack.addr;
 	}
 	ss << " interrupt=" << interrupt
 	   << " SIZE=" << packet_size();
@@ -192,15 +258,44 @@ std::string vif_code::to_string() const {
 }
 
 std::vector<vif_packet> parse_vif_chain(const stream* src, std::size_t base_address, std::size_t qwc) {
+	// Everything below is in words.
+	static const std::size_t first_chunk_size = 0x4000;
+	
+	std::size_t available = src->size() > base_address ? (src->size() - base_address) / 4 : 0;
+	std::size_t chain_end = qwc < available / 4 ? qwc * 4 : available;
+	
+	// If the size of the chain is known it's read in one go, otherwise it's
+	// read in chunks that double in size so that parsing a short chain doesn't
+	// read in the rest of the stream.
+	auto buffer = std::make_shared<std::vector<uint32_t>>();
+	auto read_up_to = [&](std::size_t end) {
+		std::size_t begin = buffer->size();
+		if(end > begin) {
+			buffer->resize(end);
+			src->peek_n(reinterpret_cast<char*>(buffer->data() + begin),
+				base_address + begin * 4, (end - begin) * 4);
+		}
+	};
+	read_up_to(qwc == SIZE_MAX ? std::min(chain_end, first_chunk_size) : chain_end);
+	
 	std::vector<vif_packet> chain;
+	std::vector<std::size_t> packet_offsets;
+	std::vector<std::size_t> packet_sizes;
+	
+	// The sizes of UNPACK packets depend on the last STCYCL.
+	int wl = 1;
+	int cl = 1;
 	
 	std::size_t offset = 0;
-	while(offset < qwc * 16) {
+	while(offset < chain_end) {
+		if(offset >= buffer->size()) {
+			read_up_to(std::min(chain_end, std::max(offset + 1, buffer->size() * 2)));
+		}
+		
 		vif_packet vpkt;
-		vpkt.address = base_address + offset;
+		vpkt.address = base_address + offset * 4;
 		
-		uint32_t val = src->peek<uint32_t>(vpkt.address);
-		std::optional<vif_code> code = vif_code::parse(val);
+		std::optional<vif_code> code = vif_code::parse((*buffer)[offset]);
 		if(!code) {
 			vpkt.error = "failed to parse VIF code";
 			chain.push_back(vpkt);
@@ -209,25 +304,44 @@ std::vector<vif_packet> parse_vif_chain(const stream* src, std::size_t base_addr
 		
 		vpkt.code = *code;
 		
-		std::size_t packet_size = vpkt.code.packet_size();
+		if(vpkt.code.cmd == vif_cmd::STCYCL) {
+			wl = vpkt.code.stcycl.wl;
+			cl = vpkt.code.stcycl.cl;
+		}
+		
+		std::size_t packet_size = vpkt.code.packet_size(wl, cl);
 		if(packet_size > 0x10000) {
 			vpkt.error = "packet_size > 0x10000";
 			chain.push_back(vpkt);
 			break;
 		}
 		
-		for(std::size_t j = 0; j < packet_size / 4; j++) {
-			vpkt.data.push_back(src->peek<uint32_t>(base_address + offset + j * 4));
-		}
-		
-		offset += packet_size;
-		if(offset > qwc * 16) {
+		std::size_t packet_end = offset + packet_size / 4;
+		if(packet_end > chain_end) {
+			if(packet_end > available) {
+				vpkt.error = "packet extends past the end of the stream";
+				chain.push_back(vpkt);
+				break;
+			}
+			// Read the rest of the packet, so it can still be displayed.
+			read_up_to(packet_end);
 			vpkt.error = "offset > qwc * 16";
+		} else if(packet_end > buffer->size()) {
+			read_up_to(std::min(chain_end, std::max(packet_end, buffer->size() * 2)));
 		}
 		
+		packet_offsets.push_back(offset);
+		packet_sizes.push_back(packet_size / 4);
+		offset = packet_end;
 		chain.push_back(vpkt);
 	}
 	
+	// The buffer can't be resized any more, so it's safe to hand out slices.
+	std::shared_ptr<const std::vector<uint32_t>> shared_buffer = std::move(buffer);
+	for(std::size_t i = 0; i < packet_offsets.size(); i++) {
+		chain[i].data = vif_data_slice(shared_buffer, packet_offsets[i], packet_sizes[i]);
+	}
+	
 	return chain;
 }
 
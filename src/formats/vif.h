@@ -19,7 +19,9 @@
 #ifndef FORMATS_VIF_H
 #define FORMATS_VIF_H
 
+#include <memory>
 #include <string>
+#include <vector>
 #include <optional>
 #include <better-enums/enum.h>
 
@@ -126,19 +128,48 @@ struct vif_code {
 	vif_code() {}
 	static std::optional<vif_code> parse(uint32_t val);
 	bool is_unpack() const;
-	std::size_t packet_size() const; // In bytes.
+	std::size_t packet_size() const; // In bytes, assuming WL <= CL.
+	// In filling mode (WL > CL) an UNPACK's num counts qwords written rather
+	// than vectors read, so its size depends on the last STCYCL.
+	std::size_t packet_size(int wl, int cl) const;
+	std::size_t unpack_num_inputs(int wl, int cl) const;
 	std::string to_string() const;
 };
 
+// Part of a buffer shared by all the packets of a chain, which is kept alive
+// for as long as any of them are.
+class vif_data_slice {
+public:
+	vif_data_slice() {}
+	vif_data_slice(std::shared_ptr<const std::vector<uint32_t>> buffer, std::size_t begin, std::size_t size)
+		: _buffer(std::move(buffer)), _begin(begin), _size(size) {}
+
+	const uint32_t* data() const { return _buffer ? _buffer->data() + _begin : nullptr; }
+	std::size_t size() const { return _size; }
+	const uint32_t* begin() const { return data(); }
+	const uint32_t* end() const { return data() + _size; }
+	uint32_t operator[](std::size_t index) const { return data()[index]; }
+
+private:
+	std::shared_ptr<const std::vector<uint32_t>> _buffer;
+	std::size_t _begin = 0;
+	std::size_t _size = 0;
+};
+
 struct vif_packet {
 	std::size_t address;
 	vif_code code;
-	std::vector<uint32_t> data; // Including the code.
+	vif_data_slice data; // Including the code.
 	std::string error;
 };
 
+// Reads the chain into a single buffer and parses it in memory. Pass SIZE_MAX
+// for qwc to parse until an invalid code or the end of the stream.
 std::vector<vif_packet> parse_vif_chain(const stream* src, std::size_t base_address, std::size_t qwc);
 
+// e.g. "STCYCL", or "UNPACK" for every unpack command. nullptr if invalid.
+const char* vif_cmd_name(vif_cmd cmd);
+
 uint64_t bit_range(uint64_t val, int lo, int hi);
 
 #endif
@@ -0,0 +1,314 @@
+/*
+	wrench - A set of modding tools for the Ratchet & Clank PS2 games.
+	Copyright (C) 2019-2020 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "vif_executor.h"
+
+#include <algorithm>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Bytes of input data per vector, or zero for the invalid formats. V4_5
+// packs a whole vector into 16 bits.
+static std::size_t unpack_vector_size(int vn, int vl) {
+	if(vl == vif_vl::B5551) {
+		return vn == vif_vn::FOUR ? 2 : 0;
+	}
+	return (vn + 1) * (4 >> vl);
+}
+
+static uint32_t read_element(const uint8_t* src, int vl, bool is_unsigned) {
+	switch(vl) {
+		case vif_vl::QWORD: {
+			uint32_t value;
+			std::memcpy(&value, src, 4);
+			return value;
+		}
+		case vif_vl::DWORD: {
+			uint16_t value;
+			std::memcpy(&value, src, 2);
+			return is_unsigned ? value : static_cast<uint32_t>(static_cast<int16_t>(value));
+		}
+		default:
+			return is_unsigned ? *src : static_cast<uint32_t>(static_cast<int8_t>(*src));
+	}
+}
+
+// The components the hardware leaves undefined (z and w for V2, w for V3)
+// are written as zero.
+static void expand_vector_scalar(uint32_t* dest, const uint8_t* src, int vn, int vl, bool is_unsigned) {
+	if(vl == vif_vl::B5551) {
+		uint16_t value;
+		std::memcpy(&value, src, 2);
+		dest[0] = (value & 0x1f) << 3;
+		dest[1] = ((value >> 5) & 0x1f) << 3;
+		dest[2] = ((value >> 10) & 0x1f) << 3;
+		dest[3] = (value >> 15) << 7;
+		return;
+	}
+	if(vn == vif_vn::ONE) {
+		uint32_t value = read_element(src, vl, is_unsigned);
+		dest[0] = dest[1] = dest[2] = dest[3] = value;
+		return;
+	}
+	int size = 4 >> vl;
+	for(int i = 0; i < 4; i++) {
+		dest[i] = i <= vn ? read_element(src + i * size, vl, is_unsigned) : 0;
+	}
+}
+
+#ifdef __SSE2__
+// Widens a whole vector with a single load of 16 >> vl bytes, which may read
+// past the end of it, so the caller has to check there's that much data left.
+static __m128i expand_vector_sse2(const uint8_t* src, int vn, int vl, bool is_unsigned) {
+	__m128i zero = _mm_setzero_si128();
+	__m128i value;
+	switch(vl) {
+		case vif_vl::QWORD:
+			value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+			break;
+		case vif_vl::DWORD: {
+			__m128i halves = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src));
+			value = is_unsigned
+				? _mm_unpacklo_epi16(halves, zero)
+				: _mm_srai_epi32(_mm_unpacklo_epi16(halves, halves), 16);
+			break;
+		}
+		default: {
+			int32_t word;
+			std::memcpy(&word, src, 4);
+			__m128i bytes = _mm_cvtsi32_si128(word);
+			if(is_unsigned) {
+				value = _mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, zero), zero);
+			} else {
+				// Put each byte at the top of its lane, then shift it back down.
+				bytes = _mm_unpacklo_epi8(bytes, bytes);
+				value = _mm_srai_epi32(_mm_unpacklo_epi16(bytes, bytes), 24);
+			}
+		}
+	}
+	switch(vn) {
+		case vif_vn::ONE:   return _mm_shuffle_epi32(value, 0);
+		case vif_vn::TWO:   return _mm_unpacklo_epi64(value, zero);
+		case vif_vn::THREE: return _mm_and_si128(value, _mm_set_epi32(0, -1, -1, -1));
+		default:            return value;
+	}
+}
+#endif
+
+// Unpacks count vectors into dest, one per qword. available is the number of
+// bytes that can safely be read from src, which may be more than are used.
+static void expand_vectors(uint32_t (*dest)[4], const uint8_t* src, std::size_t available, std::size_t count, int vn, int vl, bool is_unsigned) {
+	std::size_t stride = unpack_vector_size(vn, vl);
+	std::size_t i = 0;
+#ifdef __SSE2__
+	if(vl != vif_vl::B5551) {
+		std::size_t load_size = 16 >> vl;
+		for(; i < count && i * stride + load_size <= available; i++) {
+			_mm_store_si128(reinterpret_cast<__m128i*>(dest[i]), expand_vector_sse2(src + i * stride, vn, vl, is_unsigned));
+		}
+	}
+#endif
+	for(; i < count; i++) {
+		expand_vector_scalar(dest[i], src + i * stride, vn, vl, is_unsigned);
+	}
+}
+
+void vif1_executor::execute(const std::vector<vif_packet>& chain, const microprogram_callback& on_microprogram) {
+	_written_begin = MEMORY_QWORDS;
+	_written_end = 0;
+	for(const vif_packet& packet : chain) {
+		if(packet.data.size() == 0) {
+			_num_errors++; // The parser gave up on it.
+			continue;
+		}
+		
+		const vif_code& code = packet.code;
+		if(code.is_unpack()) {
+			unpack(packet);
+			continue;
+		}
+		
+		switch(code.cmd) {
+			case vif_cmd::STCYCL:
+				_cl = code.stcycl.cl;
+				_wl = code.stcycl.wl;
+				break;
+			case vif_cmd::OFFSET:
+				_offset = code.offset.offset;
+				_dbf = false;
+				_tops = _base;
+				break;
+			case vif_cmd::BASE:
+				_base = code.base.base;
+				break;
+			case vif_cmd::STMOD:
+				_mode = code.stmod.mode;
+				break;
+			case vif_cmd::MSCAL:
+				start_microprogram(code.mscal.execaddr, on_microprogram);
+				break;
+			case vif_cmd::MSCALF:
+				start_microprogram(code.mscalf.execaddr, on_microprogram);
+				break;
+			case vif_cmd::MSCNT:
+				start_microprogram(-1, on_microprogram);
+				break;
+			case vif_cmd::STMASK:
+				_mask = packet.data[1];
+				break;
+			case vif_cmd::STROW:
+				std::copy(packet.data.begin() + 1, packet.data.end(), _row);
+				break;
+			case vif_cmd::STCOL:
+				std::copy(packet.data.begin() + 1, packet.data.end(), _col);
+				break;
+			default:
+				break; // Doesn't touch VU memory.
+		}
+	}
+}
+
+bool vif1_executor::written_range(int& begin, int& end) const {
+	begin = _written_begin;
+	end = _written_end;
+	return begin < end;
+}
+
+void vif1_executor::unpack(const vif_packet& packet) {
+	const vif_code& code = packet.code;
+	int vn = code.unpack.vn;
+	int vl = code.unpack.vl;
+	std::size_t stride = unpack_vector_size(vn, vl);
+	if(stride == 0 || _wl == 0) {
+		_num_errors++;
+		return;
+	}
+	
+	// When WL > CL, num counts qwords written rather than vectors read, and
+	// only the first CL qwords of each cycle come from the input data.
+	std::size_t num = code.num;
+	bool filling = _wl > _cl;
+	std::size_t num_inputs = code.unpack_num_inputs(_wl, _cl);
+	
+	const uint8_t* src = reinterpret_cast<const uint8_t*>(packet.data.data() + 1);
+	std::size_t available = (packet.data.size() - 1) * 4;
+	if(num_inputs * stride > available) {
+		_num_errors++;
+		return;
+	}
+	expand_vectors(_scratch, src, available, num_inputs, vn, vl, code.unpack.usn == +vif_usn::UNSIGNED);
+	
+	int address = code.unpack.addr;
+	if(code.unpack.flg == +vif_flg::USE_VIF1_TOPS) {
+		address += _tops;
+	}
+	bool masked = static_cast<int>(code.cmd) & 0b10000;
+	
+	std::size_t input = 0;
+	int cycle = 0;
+	for(std::size_t i = 0; i < num; i++) {
+		int dest_address = (address + cycle) & (MEMORY_QWORDS - 1);
+		uint32_t* dest = _memory[dest_address];
+		bool from_input = !filling || cycle < _cl;
+		const uint32_t* vector = from_input ? _scratch[input++] : nullptr;
+		
+		_written_begin = std::min(_written_begin, dest_address);
+		_written_end = std::max(_written_end, dest_address + 1);
+		
+		int mask_cycle = std::min(cycle, 3);
+		if(++cycle == _wl) {
+			// Skipping writes leave a gap of CL - WL qwords between cycles.
+			address += filling ? _wl : _cl;
+			cycle = 0;
+		}
+		
+		if(!masked && from_input) {
+#ifdef __SSE2__
+			__m128i value = _mm_load_si128(reinterpret_cast<const __m128i*>(vector));
+			__m128i row = _mm_load_si128(reinterpret_cast<const __m128i*>(_row));
+			if(_mode == 1) {
+				value = _mm_add_epi32(value, row);
+			} else if(_mode == 2) {
+				value = _mm_add_epi32(value, row);
+				_mm_store_si128(reinterpret_cast<__m128i*>(_row), value);
+			}
+			_mm_store_si128(reinterpret_cast<__m128i*>(dest), value);
+#else
+			for(int j = 0; j < 4; j++) {
+				uint32_t value = vector[j];
+				if(_mode == 1 || _mode == 2) {
+					value += _row[j];
+				}
+				if(_mode == 2) {
+					_row[j] = value;
+				}
+				dest[j] = value;
+			}
+#endif
+			continue;
+		}
+		
+		// Each cycle has its own mask for each component. The qwords that
+		// aren't filled from the input data during a filling write are
+		// written as if their mask was 1 (the row register) unless it says
+		// otherwise.
+		for(int j = 0; j < 4; j++) {
+			int mask = masked ? (_mask >> ((mask_cycle * 4 + j) * 2)) & 0b11 : 0;
+			switch(mask) {
+				case 0:
+					if(from_input) {
+						uint32_t value = vector[j];
+						if(_mode == 1 || _mode == 2) {
+							value += _row[j];
+						}
+						if(_mode == 2) {
+							_row[j] = value;
+						}
+						dest[j] = value;
+					} else {
+						dest[j] = _row[j];
+					}
+					break;
+				case 1: dest[j] = _row[j]; break;
+				case 2: dest[j] = _col[mask_cycle]; break;
+				case 3: break; // Write protected.
+			}
+		}
+	}
+}
+
+void vif1_executor::start_microprogram(int execaddr, const microprogram_callback& on_microprogram) {
+	_top = _tops;
+	if(on_microprogram) {
+		on_microprogram(*this, execaddr);
+	}
+	_written_begin = MEMORY_QWORDS;
+	_written_end = 0;
+	
+	// Swap the double buffers, so the next batch of data is unpacked to the
+	// other half while the microprogram runs.
+	if(_dbf) {
+		_tops = _base;
+		_dbf = false;
+	} else {
+		_tops = _base + _offset;
+		_dbf = true;
+	}
+}
@@ -0,0 +1,79 @@
+/*
+	wrench - A set of modding tools for the Ratchet & Clank PS2 games.
+	Copyright (C) 2019-2020 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef FORMATS_VIF_EXECUTOR_H
+#define FORMATS_VIF_EXECUTOR_H
+
+#include <functional>
+
+#include "vif.h"
+
+# /*
+#	Executes the parts of a VIF1 chain that write to VU1 data memory, so the
+#	vectors a microprogram would see can be read back directly instead of
+#	being guessed at from the packed data. Handles every UNPACK format along
+#	with STCYCL, STMOD, STMASK, STROW, STCOL and OFFSET/BASE double buffering.
+# */
+
+class vif1_executor {
+public:
+	static constexpr int MEMORY_QWORDS = 1024;
+
+	// Called when the chain would start a microprogram (MSCAL, MSCALF or
+	// MSCNT), with execaddr set to -1 for MSCNT.
+	using microprogram_callback = std::function<void(const vif1_executor& vif, int execaddr)>;
+
+	void execute(const std::vector<vif_packet>& chain, const microprogram_callback& on_microprogram = nullptr);
+
+	// Addresses are in qwords and wrap around like they do on the VU.
+	const uint32_t* qword(int address) const { return _memory[address & (MEMORY_QWORDS - 1)]; }
+	// The TOP register as of the last microprogram call.
+	int top() const { return _top; }
+	// Qwords written since the last microprogram call, or since execute was
+	// called if there hasn't been one. Returns false if there weren't any.
+	bool written_range(int& begin, int& end) const;
+	// Packets that couldn't be executed, e.g. unpacks without enough data.
+	std::size_t num_errors() const { return _num_errors; }
+
+private:
+	void unpack(const vif_packet& packet);
+	void start_microprogram(int execaddr, const microprogram_callback& on_microprogram);
+
+	alignas(16) uint32_t _memory[MEMORY_QWORDS][4] = {};
+	alignas(16) uint32_t _scratch[256][4]; // Unpacked input vectors.
+
+	// Defaults to contiguous writes, like parse_vif_chain assumes.
+	int _cl = 1;
+	int _wl = 1;
+	int _mode = 0;
+	uint32_t _mask = 0;
+	alignas(16) uint32_t _row[4] = {};
+	uint32_t _col[4] = {};
+
+	int _base = 0;
+	int _offset = 0;
+	int _tops = 0;
+	int _top = 0;
+	bool _dbf = false;
+
+	int _written_begin = 0;
+	int _written_end = 0;
+	std::size_t _num_errors = 0;
+};
+
+#endif
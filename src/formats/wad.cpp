@@ -28,7 +28,7 @@
 // If this code breaks, dump the correct output and point to that here.
 //#define WAD_DEBUG_EXPECTED_PATH "<file path goes here>"
 
-bool validate_wad(char* magic) {
+bool validate_wad(const char* magic) {
 	return std::memcmp(magic, "WAD", 3) == 0;
 }
 
@@ -36,6 +36,42 @@ void decompress_wad(array_stream& dest, array_stream& src) {
 	decompress_wad_n(dest, src, 0);
 }
 
+void decompress_wad_prefix(array_stream& dest, stream& src, std::size_t offset, std::size_t bytes_to_decompress) {
+	// Most of the time only the first few KiB of compressed data are needed.
+	// Padding packets can skip ahead quite far though, so if that's not
+	// enough fall back to reading the whole segment.
+	static const std::size_t max_prefix_size = 0x2000;
+	
+	std::size_t compressed_size = std::min(
+		(std::size_t) src.read<wad_header>(offset).total_size,
+		src.size() - offset);
+	std::size_t prefix_size = compressed_size;
+	if(bytes_to_decompress != 0) {
+		prefix_size = std::min(compressed_size, max_prefix_size);
+	}
+	for(;;) {
+		array_stream compressed;
+		compressed.buffer.resize(prefix_size);
+		src.seek(offset);
+		src.read_n(compressed.data(), prefix_size);
+		
+		dest = array_stream();
+		try {
+			decompress_wad_n(dest, compressed, bytes_to_decompress);
+		} catch(stream_io_error& e) {
+			if(prefix_size < compressed_size) {
+				prefix_size = compressed_size;
+				continue;
+			}
+			throw;
+		} catch(std::out_of_range& e) {
+			// A lookback pointed outside of the decompressed data.
+			throw stream_format_error("Invalid WAD segment.");
+		}
+		return;
+	}
+}
+
 // We don't want to use stream::copy_n since it uses virtual functions.
 void copy_bytes(array_stream& dest, array_stream& src, std::size_t bytes) {
 	for(std::size_t i = 0; i < bytes; i++) {
@@ -38,12 +38,18 @@ packed_struct(wad_header,
 )
 
 // Check the magic bytes.
-bool validate_wad(char* magic);
+bool validate_wad(const char* magic);
 
 // Throws stream_io_error, stream_format_error.
 void decompress_wad(array_stream& dest, array_stream& src);
 void decompress_wad_n(array_stream& dest, array_stream& src, std::size_t bytes_to_decompress);
 
+// Decompress at least the first bytes_to_decompress bytes of the WAD segment
+// at the given offset of src, reading as little of it as possible. If
+// bytes_to_decompress is zero, the whole segment is decompressed.
+// Throws stream_io_error, stream_format_error.
+void decompress_wad_prefix(array_stream& dest, stream& src, std::size_t offset, std::size_t bytes_to_decompress);
+
 void compress_wad(array_stream& dest, array_stream& src);
 
 #endif
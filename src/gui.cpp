@@ -18,6 +18,8 @@
 
 #include "gui.h"
 
+#include <cstring>
+#include <chrono>
 #include <fstream>
 #include <iomanip>
 #include <sstream>
@@ -30,7 +32,9 @@
 #include "window.h"
 #include "platform.h"
 #include "renderer.h"
+#include "thumbnail_cache.h"
 #include "formats/bmp.h"
+#include "formats/vif_executor.h"
 #include "commands/translate_command.h"
 
 void gui::render(app& a) {
@@ -283,7 +287,6 @@ void gui::project_tree::render(app& a) {
 	}
 	
 	auto& project = *a.get_project();
-	auto game = a.game_db.at(project.game_id);
 	
 	static gamedb_file_type selected_type = gamedb_file_type::ARMOR;
 	static std::size_t selected_offset = 0x0;
@@ -303,14 +306,14 @@ void gui::project_tree::render(app& a) {
 	
 	ImGui::BeginChild(1);
 	
-	for(gamedb_file file : game.files) {
+	for(gamedb_file file : project.files()) {
 		if(file.type != +gamedb_file_type::LEVEL) {
 			render_selectable(file, " ");
 		}
 	}
 	
 	if(ImGui::TreeNode("Levels")) {
-		for(gamedb_file file : game.files) {
+		for(gamedb_file file : project.files()) {
 			if(file.type == +gamedb_file_type::LEVEL) {
 				if(render_selectable(file, "")) {
 					a.renderer.reset_camera(&a);
@@ -583,7 +586,8 @@ void gui::string_viewer::render(app& a) {
 	texture_browser
 */
 
-gui::texture_browser::texture_browser() {}
+gui::texture_browser::texture_browser()
+	: _decoder(std::max((std::size_t) 2, default_num_threads()) - 1, 32, 128) {}
 
 gui::texture_browser::~texture_browser() {
 	for(auto& tex : _gl_textures) {
@@ -607,14 +611,18 @@ void gui::texture_browser::render(app& a) {
 	
 	// Clear the texture cache when a new project is opened.
 	if(a.get_project()->id() != _project_id) {
-		for(auto& tex : _gl_textures) {
-			glDeleteTextures(1, &tex.second);
-		}
-		_gl_textures.clear();
+		reset_textures();
+		_duplicates.reset();
 		_project_id = a.get_project()->id();
 	}
 
 	auto tex_lists = a.get_project()->texture_lists();
+	if(!_duplicates) {
+		_duplicates.emplace(tex_lists);
+	}
+	// Finding duplicates reads every texture, and streams can only be read
+	// from this thread, so only spend a little time on it each frame.
+	_duplicates->index_some(std::chrono::milliseconds(4));
 	if(tex_lists.find(_list) == tex_lists.end()) {
 		if(tex_lists.size() > 0) {
 			_list = tex_lists.begin()->first;
@@ -659,6 +667,12 @@ void gui::texture_browser::render(app& a) {
 				vec2i size = textures[_selection].size();
 				ImGui::Text("Width:  %d", size.x);
 				ImGui::Text("Height: %d", size.y);
+				int num_duplicates = (int) _duplicates->copies_of(&textures[_selection]).size() - 1;
+				if(_duplicates->finished()) {
+					ImGui::Text("Duplicates: %d", num_duplicates);
+				} else {
+					ImGui::Text("Duplicates: %d (searching)", num_duplicates);
+				}
 			} else {
 				ImGui::Text("<no texture selected>");
 			}
@@ -668,6 +682,7 @@ void gui::texture_browser::render(app& a) {
 
 		if(ImGui::TreeNodeEx("Actions", ImGuiTreeNodeFlags_DefaultOpen)) {
 			if(textures.size() > 0) {
+				ImGui::Checkbox("Edit All Copies", &_edit_all_copies);
 				if(ImGui::Button("Replace Selected")) {
 					import_bmp(a, &textures[_selection]);
 				}
@@ -688,80 +703,134 @@ void gui::texture_browser::render(app& a) {
 }
 
 void gui::texture_browser::render_grid(app& a, std::vector<texture>& tex_list) {
-	int num_this_frame = 0;
+	upload_decoded_textures();
 
+	std::vector<std::size_t> filtered;
 	for(std::size_t i = 0; i < tex_list.size(); i++) {
-		texture* tex = &tex_list[i];
-
-		if(tex->size().x < _filters.min_width) {
-			continue;
+		if(tex_list[i].size().x >= _filters.min_width) {
+			filtered.push_back(i);
 		}
+	}
 
-		if(_gl_textures.find(tex) == _gl_textures.end()) {
-
-			// Only load 10 textures per frame.
-			if(num_this_frame >= 10) {
+	// Only the rows that are scrolled into view are drawn, so only the
+	// textures in those rows are ever decoded.
+	int num_columns = ImGui::GetColumnsCount();
+	int num_rows = (filtered.size() + num_columns - 1) / num_columns;
+	ImGuiListClipper clipper;
+	clipper.Begin(num_rows);
+	while(clipper.Step()) {
+		for(int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+			for(int column = 0; column < num_columns; column++) {
+				std::size_t i = row * num_columns + column;
+				if(i < filtered.size()) {
+					render_grid_item(tex_list, filtered[i]);
+				}
 				ImGui::NextColumn();
-				continue;
 			}
+		}
+	}
+	clipper.End();
+}
 
-			cache_texture(tex);
-			num_this_frame++;
+void gui::texture_browser::render_grid_item(std::vector<texture>& tex_list, std::size_t index) {
+	texture* tex = &tex_list[index];
+	texture* representative = _duplicates->representative(tex);
+
+	bool clicked;
+	auto gl_texture = _gl_textures.find(representative);
+	if(gl_texture == _gl_textures.end()) {
+		if(_requested.insert(representative).second) {
+			_decoder.request(representative, _generation, representative);
 		}
 
-		bool clicked = ImGui::ImageButton(
-			(void*) (intptr_t) _gl_textures.at(tex),
+		// Same size as the image button so the grid doesn't move around
+		// when the texture arrives.
+		ImVec2 padding = ImGui::GetStyle().FramePadding;
+		std::string label = std::string("##") + std::to_string(index);
+		clicked = ImGui::Button(label.c_str(), ImVec2(128 + padding.x * 2, 128 + padding.y * 2));
+	} else {
+		clicked = ImGui::ImageButton(
+			(void*) (intptr_t) gl_texture->second,
 			ImVec2(128, 128),
 			ImVec2(0, 0),
 			ImVec2(1, 1),
-			(_selection == i) ? 2 : 0,
+			(_selection == index) ? 2 : 0,
 			ImVec4(0, 0, 0, 1),
 			ImVec4(1, 1, 1, 1)
 		);
-		if(clicked) {
-			_selection = i;
+	}
+	if(clicked) {
+		_selection = index;
+	}
+
+	std::string display_name =
+		std::to_string(index) + " " + tex->name;
+	std::size_t num_copies = _duplicates->copies_of(tex).size();
+	if(num_copies > 1) {
+		display_name += " (" + std::to_string(num_copies - 1) + " duplicates)";
+	}
+	ImGui::Text("%s", display_name.c_str());
+}
+
+void gui::texture_browser::upload_decoded_textures() {
+	// Uploading is the part that has to happen on this thread, so limit how
+	// much of each frame it can take up.
+	static const auto time_budget = std::chrono::milliseconds(4);
+
+	auto start_time = std::chrono::steady_clock::now();
+	while(std::chrono::steady_clock::now() - start_time < time_budget) {
+		std::optional<decoded_texture> decoded = _decoder.pop_finished();
+		if(!decoded) {
+			break;
 		}
+		texture* tex = const_cast<texture*>(static_cast<const texture*>(decoded->key));
+		_requested.erase(tex);
+		if(decoded->tag != _generation || _gl_textures.find(tex) != _gl_textures.end()) {
+			continue; // Stale, or replaced since it was requested.
+		}
+		_gl_textures[tex] = upload_texture(decoded->size, decoded->rgba.data());
+	}
+}
 
-		std::string display_name =
-			std::to_string(i) + " " + tex->name;
-		ImGui::Text("%s", display_name.c_str());
-		ImGui::NextColumn();
+void gui::texture_browser::reset_textures() {
+	for(auto& tex : _gl_textures) {
+		glDeleteTextures(1, &tex.second);
 	}
+	_gl_textures.clear();
+	_requested.clear();
+	_decoder.clear();
+	_generation++; // Drop anything the decoder was already working on.
 }
 
 void gui::texture_browser::cache_texture(texture* tex) {
-	auto size = tex->size();
-
-	// Prepare pixel data.
-	std::vector<uint8_t> indexed_pixel_data = tex->pixel_data();
-	std::vector<uint8_t> colour_data(indexed_pixel_data.size() * 4);
-	auto palette = tex->palette();
-	for(std::size_t i = 0; i < indexed_pixel_data.size(); i++) {
-		colour c = palette[indexed_pixel_data[i]];
-		colour_data[i * 4] = c.r;
-		colour_data[i * 4 + 1] = c.g;
-		colour_data[i * 4 + 2] = c.b;
-		colour_data[i * 4 + 3] = static_cast<int>(c.a) * 2 - 1;
+	auto gl_texture = _gl_textures.find(tex);
+	if(gl_texture != _gl_textures.end()) {
+		glDeleteTextures(1, &gl_texture->second);
 	}
+	_gl_textures[tex] = upload_texture(tex->size(), tex->rgba()->data());
+	tex->drop_decoded_data();
+}
 
-	// Send image to OpenGL.
+GLuint gui::texture_browser::upload_texture(vec2i size, const colour* data) {
 	GLuint texture_id;
 	glGenTextures(1, &texture_id);
 	glBindTexture(GL_TEXTURE_2D, texture_id);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size.x, size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, colour_data.data());
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size.x, size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-
-	_gl_textures[tex] = texture_id;
+	return texture_id;
 }
 
 void gui::texture_browser::import_bmp(app& a, texture* tex) {
+	bool all_copies = _edit_all_copies;
 	auto importer = std::make_unique<string_input>("Enter Import Path");
 	importer->on_okay([=](app& a, std::string path) {
 		try {
 			file_stream bmp_file(path);
+			std::array<colour, 256> old_palette = tex->palette();
+			std::vector<uint8_t> old_pixels = tex->pixel_data();
 			bmp_to_texture(tex, bmp_file);
-			cache_texture(tex);
+			texture_changed(tex, all_copies, old_palette, old_pixels);
 		} catch(stream_error& e) {
 			a.emplace_window<message_box>("Error", e.what());
 		}
@@ -770,14 +839,7 @@ void gui::texture_browser::import_bmp(app& a, texture* tex) {
 }
 
 void gui::texture_browser::export_bmp(app& a, texture* tex) {
-	// Filter out characters not allowed in file paths (on certain platforms).
-	std::string default_file_path = tex->pixel_data_path() + ".bmp";
-	const static std::string foridden = "<>:\"/\\|?*";
-	for(char& c : default_file_path) {
-		if(std::find(foridden.begin(), foridden.end(), c) != foridden.end()) {
-			c = '_';
-		}
-	}
+	std::string default_file_path = sanitise_file_name(tex->pixel_data_path() + ".bmp");
 
 	auto exporter = std::make_unique<string_input>
 		("Enter Export Path", default_file_path);
@@ -792,6 +854,52 @@ void gui::texture_browser::export_bmp(app& a, texture* tex) {
 	a.windows.emplace_back(std::move(exporter));
 }
 
+void gui::texture_browser::texture_changed(
+		texture* tex,
+		bool all_copies,
+		const std::array<colour, 256>& old_palette,
+		const std::vector<uint8_t>& old_pixels) {
+	std::vector<texture*> copies = _duplicates ? _duplicates->copies_of(tex) : std::vector<texture*> { tex };
+	bool regroup = !all_copies && copies.size() > 1;
+	if(all_copies) {
+		std::array<colour, 256> palette = tex->palette();
+		std::vector<uint8_t> pixels = tex->pixel_data();
+		for(texture* copy : copies) {
+			if(copy == tex) {
+				continue;
+			}
+			// Copies were only grouped by their hash, so make sure this one
+			// really is the same as the texture was before it was replaced.
+			std::array<colour, 256> copy_palette = copy->palette();
+			bool same =
+				copy->size().x == tex->size().x &&
+				copy->size().y == tex->size().y &&
+				std::memcmp(copy_palette.data(), old_palette.data(), sizeof(old_palette)) == 0 &&
+				copy->pixel_data() == old_pixels;
+			if(same) {
+				copy->set_palette(palette);
+				copy->set_pixel_data(pixels);
+			} else {
+				regroup = true;
+			}
+		}
+	}
+	// Textures that haven't been indexed yet would be grouped using the hash
+	// of the old contents, so start again if the search hadn't finished.
+	if(_duplicates && !_duplicates->finished()) {
+		regroup = true;
+	}
+	if(regroup) {
+		// The texture may have been split off from some of its old copies, so
+		// regroup everything. The thumbnails will come back from the disk
+		// cache.
+		reset_textures();
+		_duplicates.reset();
+	} else {
+		cache_texture(copies.front());
+	}
+}
+
 /*
 	model_browser
 */
@@ -851,7 +959,11 @@ void gui::model_browser::render(app& a) {
 	
 	ImVec2 preview_size { 400, 300 };
 	static GLuint preview_texture = 0;
-	render_preview(&preview_texture, *model, a.renderer, preview_size, _zoom, _pitch_yaw);
+	glm::vec2 pitch_yaw = _pitch_yaw;
+	if(ImGui::IsMouseDragging()) {
+		pitch_yaw += get_drag_delta();
+	}
+	render_preview(&preview_texture, *model, a.renderer, preview_size, _zoom, pitch_yaw);
 	ImGui::Image((void*) (intptr_t) preview_texture, preview_size);
 	
 	if(ImGui::BeginTabBar("tabs")) {
@@ -914,11 +1026,7 @@ game_model* gui::model_browser::render_selection_grid(
 				continue;
 			}
 			
-			_model_thumbnails[model] = 0;
-			render_preview(
-				&_model_thumbnails.at(model),
-				*model, a.renderer,
-				ImVec2(128, 128), 1, glm::vec2(0, 0));
+			_model_thumbnails[model] = load_or_render_thumbnail(*model, a.renderer);
 			num_this_frame++;
 		}
 		
@@ -956,11 +1064,7 @@ void gui::model_browser::render_preview(
 		ImVec2 preview_size,
 		float zoom,
 		glm::vec2 pitch_yaw) {
-	if(ImGui::IsMouseDragging()) {
-		pitch_yaw += get_drag_delta();
-	}
-	
-	glm::vec3 eye = glm::vec3(_zoom, 0, 0);
+	glm::vec3 eye = glm::vec3(zoom, 0, 0);
 	
 	glm::mat4 view_fixed = glm::lookAt(eye, glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
 	glm::mat4 view_pitched = glm::rotate(view_fixed, pitch_yaw.x, glm::vec3(0, 0, 1));
@@ -1006,6 +1110,45 @@ void gui::model_browser::render_preview(
 	glDeleteFramebuffers(1, &fb_id);
 }
 
+GLuint gui::model_browser::load_or_render_thumbnail(const game_model& model, const gl_renderer& renderer) {
+	static const int thumbnail_size = 128;
+
+	std::string cache_key;
+	try {
+		std::vector<float> triangles = model.triangles();
+		cache_key = thumbnail_key("model1", { { triangles.data(), triangles.size() * sizeof(float) } });
+	} catch(stream_error& e) {
+		// render_preview will draw the error state, which isn't worth caching.
+	}
+
+	if(cache_key != "") {
+		if(std::optional<thumbnail> thumb = load_thumbnail(cache_key)) {
+			GLuint texture_id;
+			glGenTextures(1, &texture_id);
+			glBindTexture(GL_TEXTURE_2D, texture_id);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, thumb->size.x, thumb->size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, thumb->pixels.data());
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			return texture_id;
+		}
+	}
+
+	GLuint texture_id = 0;
+	render_preview(
+		&texture_id,
+		model, renderer,
+		ImVec2(thumbnail_size, thumbnail_size), 1, glm::vec2(0, 0));
+
+	if(cache_key != "") {
+		thumbnail thumb { { thumbnail_size, thumbnail_size }, std::vector<colour>(thumbnail_size * thumbnail_size) };
+		glBindTexture(GL_TEXTURE_2D, texture_id);
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, thumb.pixels.data());
+		save_thumbnail(cache_key, thumb);
+	}
+
+	return texture_id;
+}
+
 glm::vec2 gui::model_browser::get_drag_delta() const {
 	auto delta = ImGui::GetMouseDragDelta();
 	return glm::vec2(delta.y, delta.x) * 0.01f;
@@ -1016,13 +1159,13 @@ void gui::model_browser::render_dma_debug_info(game_model& mdl) {
 		ImGui::PushID(submodel);
 		
 		if(ImGui::TreeNode("submodel", "Submodel %ld", submodel)) {
-			std::vector<std::vector<vif_packet>> chains = {
+			std::vector<vif_chain_ptr> chains = {
 				mdl.get_vif_chain(submodel)
 			};
 			for(int i = 0; i < 1; i++) {
-				auto& chain = chains[i];
+				const std::vector<vif_packet>& chain = *chains[i];
 				ImGui::Text("  Chain %d:", i);
-				for(vif_packet& vpkt : chain) {
+				for(const vif_packet& vpkt : chain) {
 					ImGui::PushID(vpkt.address);
 						
 					if(vpkt.error != "") {
@@ -1041,6 +1184,29 @@ void gui::model_browser::render_dma_debug_info(game_model& mdl) {
 					}
 					ImGui::PopID();
 				}
+				
+				if(ImGui::TreeNode("vu1", "  VU1 Memory")) {
+					// Show what each microprogram call would have been given.
+					auto vif = std::make_unique<vif1_executor>();
+					int call = 0;
+					vif->execute(chain, [&](const vif1_executor& state, int execaddr) {
+						ImGui::PushID(call++);
+						int begin, end;
+						if(state.written_range(begin, end) &&
+								ImGui::TreeNode("call", "Microprogram %x (TOP=%x)", execaddr, state.top())) {
+							auto lines = to_hex_dump(state.qword(begin), begin * 0x10, (end - begin) * 4);
+							for(std::string& line : lines) {
+								ImGui::Text("    %s", line.c_str());
+							}
+							ImGui::TreePop();
+						}
+						ImGui::PopID();
+					});
+					if(vif->num_errors() > 0) {
+						ImGui::Text("   (%ld packets couldn't be executed)", vif->num_errors());
+					}
+					ImGui::TreePop();
+				}
 			}
 			ImGui::TreePop();
 		}
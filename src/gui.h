@@ -28,6 +28,8 @@
 #include "app.h"
 #include "window.h"
 #include "view_3d.h"
+#include "texture_decoder.h"
+#include "texture_duplicates.h"
 #include "formats/game_model.h"
 #include "formats/level_impl.h"
 
@@ -217,13 +219,30 @@ namespace gui {
 		};
 
 		void render_grid(app& a, std::vector<texture>& tex_list);
+		void render_grid_item(std::vector<texture>& tex_list, std::size_t index);
+		void upload_decoded_textures();
+		void reset_textures();
 		void cache_texture(texture* tex);
+		GLuint upload_texture(vec2i size, const colour* data);
 
 		void import_bmp(app& a, texture* tex);
 		void export_bmp(app& a, texture* tex);
+		// Called after tex has been replaced. With all_copies set, every copy
+		// that still matches the old palette and pixels is replaced too.
+		void texture_changed(
+			texture* tex,
+			bool all_copies,
+			const std::array<colour, 256>& old_palette,
+			const std::vector<uint8_t>& old_pixels);
 
 		int _project_id = 0;
+		int _generation = 0; // Bumped whenever decoded results become stale.
+		// Duplicates share a GL texture, keyed by their representative.
 		std::map<texture*, GLuint> _gl_textures;
+		std::set<texture*> _requested; // Sent to the decoder but not uploaded yet.
+		texture_decoder _decoder;
+		std::optional<texture_duplicates> _duplicates; // Rebuilt lazily.
+		bool _edit_all_copies = false;
 		std::string _list;
 		std::size_t _selection = 0;
 		filter_parameters _filters = { 0 };
@@ -251,6 +270,7 @@ namespace gui {
 			ImVec2 preview_size,
 			float zoom,
 			glm::vec2 pitch_yaw);
+		GLuint load_or_render_thumbnail(const game_model& model, const gl_renderer& renderer);
 		glm::vec2 get_drag_delta() const;
 		
 		static void render_dma_debug_info(game_model& mdl);
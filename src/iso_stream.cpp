@@ -74,19 +74,48 @@ std::string wad_stream::resource_path() const {
 	return std::string("wad(") + segment.resource_path() + ")";
 }
 
-void wad_stream::commit() {
-	if(!_dirty || discard) {
-		return; // The segment hasn't been modified since the last time it was committed.
+void wad_stream::coalesce_patches() {
+	std::vector<std::pair<std::size_t, std::size_t>> ranges; // [begin, end)
+	for(wad_patch& p : _wad_patches) {
+		ranges.emplace_back(p.offset, p.offset + p.buffer.size());
 	}
-	_dirty = false;
-	
+	std::sort(ranges.begin(), ranges.end());
+
+	std::vector<std::pair<std::size_t, std::size_t>> merged;
+	for(auto& range : ranges) {
+		if(merged.size() > 0 && range.first <= merged.back().second) {
+			merged.back().second = std::max(merged.back().second, range.second);
+		} else {
+			merged.push_back(range);
+		}
+	}
+
+	// Every patch has already been applied to the buffer, so the merged
+	// patches can just be read back out of it.
+	std::vector<wad_patch> patches(merged.size());
+	for(std::size_t i = 0; i < merged.size(); i++) {
+		patches[i].offset = merged[i].first;
+		patches[i].buffer.resize(merged[i].second - merged[i].first);
+		_uncompressed_buffer.peek_n(patches[i].buffer.data(), patches[i].offset, patches[i].buffer.size());
+	}
+	_wad_patches = std::move(patches);
+}
+
+bool wad_stream::needs_commit() const {
+	return _dirty && !discard;
+}
+
+array_stream wad_stream::compress() {
 	array_stream compressed_buffer;
 	_uncompressed_buffer.seek(0);
 	compress_wad(compressed_buffer, _uncompressed_buffer);
-	
-	compressed_buffer.seek(0);
+	return compressed_buffer;
+}
+
+void wad_stream::commit(array_stream& compressed) {
+	_dirty = false;
 	_backing->seek(_offset);
-	_backing->write_n(compressed_buffer.data(), compressed_buffer.size(), false);
+	_backing->write_n(compressed.data(), compressed.size(), false);
 }
 
 iso_stream::iso_stream(std::string game_id, std::string iso_path, worker_logger& log)
@@ -212,9 +241,21 @@ wad_stream* iso_stream::get_decompressed(std::size_t offset, bool discard) {
 	return _wad_streams.at(offset).get();
 }
 
-void iso_stream::commit() {
+void iso_stream::commit(std::size_t num_threads) {
+	std::vector<wad_stream*> modified;
 	for(auto& wad : _wad_streams) {
-		wad.second->commit();
+		if(wad.second->needs_commit()) {
+			modified.push_back(wad.second.get());
+		}
+	}
+
+	// Recompression is the slow part, so only that is done in parallel.
+	std::vector<array_stream> compressed(modified.size());
+	parallel_for(modified.size(), num_threads, [&](std::size_t i) {
+		compressed[i] = modified[i]->compress();
+	});
+	for(std::size_t i = 0; i < modified.size(); i++) {
+		modified[i]->commit(compressed[i]);
 	}
 }
 
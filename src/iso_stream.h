@@ -60,7 +60,16 @@ public:
 	void write_n(const char* data, std::size_t size) override;
 	std::string resource_path() const override;
 	
-	void commit();
+	// Merge overlapping and adjacent patches so that writing a whole texture
+	// set doesn't leave behind one patch per write.
+	void coalesce_patches();
+	
+	// Does the segment need to be recompressed?
+	bool needs_commit() const;
+	// Doesn't touch the backing stream, so different segments can be
+	// recompressed on different threads at the same time.
+	array_stream compress();
+	void commit(array_stream& compressed);
 
 	// HACK: Discard certain streams as the recompression code isn't currently
 	// reliable enough to compress them correctly. For example, the asset WAD
@@ -101,8 +110,9 @@ public:
 	// automatically recompressed when changes need to be commited to the cache.
 	wad_stream* get_decompressed(std::size_t offset, bool discard = false);
 	
-	// Recompress all open WAD segments.
-	void commit();
+	// Recompress all modified WAD segments, each one once, using at most
+	// num_threads threads.
+	void commit(std::size_t num_threads);
 
 private:
 
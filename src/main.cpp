@@ -23,6 +23,10 @@
 #include "app.h"
 #include "gui.h"
 #include "renderer.h"
+#include "thumbnail_cache.h"
+
+// Thumbnails past this are deleted on startup, least recently used first.
+static const uintmax_t THUMBNAIL_CACHE_LIMIT = 256 * 1024 * 1024;
 
 # /*
 #	Setup code, the main loop, and GLFW stuff.
@@ -45,6 +49,8 @@ int main(int argc, char** argv) {
 		return 0;
 	}
 
+	prune_thumbnail_cache(THUMBNAIL_CACHE_LIMIT);
+
 	app a;
 
 	if(!glfwInit()) {
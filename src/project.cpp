@@ -24,6 +24,7 @@
 
 #include "app.h"
 #include "gui.h"
+#include "util.h"
 #include "config.h"
 
 wrench_project::wrench_project(
@@ -33,6 +34,8 @@ wrench_project::wrench_project(
 	: _project_path(""),
 	  _wrench_archive(nullptr),
 	  game_id(game_id_),
+	  catalogue(load_catalogue(game_paths.at(game_id), log)),
+	  _files(resolve_files(game_id, catalogue)),
 	  _history_index(0),
 	  _selected_level(nullptr),
 	  _id(_next_id++),
@@ -45,6 +48,8 @@ wrench_project::wrench_project(
 	: _project_path(project_path),
 	  _wrench_archive(ZipFile::Open(project_path)),
 	  game_id(read_game_id()),
+	  catalogue(load_catalogue(game_paths.at(game_id), log)),
+	  _files(resolve_files(game_id, catalogue)),
 	  _history_index(0),
 	  _id(_next_id++),
 	  iso(game_id, game_paths.at(game_id), log, _wrench_archive) {
@@ -138,6 +143,10 @@ std::map<std::string, std::vector<game_model>*> wrench_project::model_lists() {
 	return result;
 }
 
+const std::vector<gamedb_file>& wrench_project::files() const {
+	return _files;
+}
+
 void wrench_project::undo() {
 	if(_history_index <= 0) {
 		throw command_error("Nothing to undo.");
@@ -184,7 +193,7 @@ void wrench_project::open_texture_archive(gamedb_file file) {
 	
 	racpak* archive = open_archive(file);
 	_texture_wads.emplace(file.name,
-		enumerate_fip_textures(&iso, archive));
+		enumerate_fip_textures(&iso, archive, catalogue));
 }
 
 void wrench_project::open_level(gamedb_file file) {
@@ -223,6 +232,25 @@ void wrench_project::save_to(std::string path) {
 	private
 */
 
+disc_catalogue wrench_project::load_catalogue(std::string iso_path, worker_logger& log) {
+	log << "[Catalogue] Loading disc catalogue... ";
+	catalogue_status status;
+	disc_catalogue result = open_disc_catalogue(iso_path, default_num_threads(), &status);
+	log << "DONE!\n";
+	if(status == catalogue_status::MISSING) {
+		log << "[Catalogue] There was no cached catalogue for this disc, so it was scanned.\n";
+	} else if(status == catalogue_status::STALE) {
+		log << "[Catalogue] The cached catalogue for this disc was out of date, so it was rescanned.\n";
+	}
+	return result;
+}
+
+std::vector<gamedb_file> wrench_project::resolve_files(std::string game_id, const disc_catalogue& catalogue) {
+	std::vector<gamedb_file> files = gamedb_parse_file().at(game_id).files;
+	catalogue.resolve_file_sizes(files);
+	return files;
+}
+
 std::string wrench_project::read_game_id() {
 	auto entry = _wrench_archive->GetEntry("game_id");
 	auto stream = entry->GetDecompressionStream();
@@ -24,6 +24,7 @@
 #include "command.h"
 #include "game_db.h"
 #include "iso_stream.h"
+#include "disc_catalogue.h"
 #include "worker_logger.h"
 #include "formats/racpak.h"
 #include "formats/game_model.h"
@@ -62,6 +63,9 @@ public:
 	std::map<std::string, std::vector<texture>*> texture_lists();
 	std::map<std::string, std::vector<game_model>*> model_lists();
 	
+	// The files listed in gamedb.txt, with unknown sizes filled in.
+	const std::vector<gamedb_file>& files() const;
+	
 	template <typename T, typename... T_constructor_args>
 	void emplace_command(T_constructor_args... args);
 	void undo();
@@ -78,6 +82,8 @@ public:
 	void save_to(std::string path);
 
 private:
+	static disc_catalogue load_catalogue(std::string iso_path, worker_logger& log);
+	static std::vector<gamedb_file> resolve_files(std::string game_id, const disc_catalogue& catalogue);
 	std::string read_game_id();
 
 	std::string _project_path;
@@ -85,8 +91,10 @@ private:
 
 public: // Initialisation order matters.
 	const std::string game_id; // e.g. "SCES_516.07"
+	const disc_catalogue catalogue;
 
 private:
+	std::vector<gamedb_file> _files;
 	std::size_t _history_index;
 	std::vector<std::unique_ptr<command>> _history_stack;
 	
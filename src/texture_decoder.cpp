@@ -0,0 +1,103 @@
+/*
+	wrench - A set of modding tools for the Ratchet & Clank PS2 games.
+	Copyright (C) 2019-2020 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "texture_decoder.h"
+
+#include "thumbnail_cache.h"
+
+texture_decoder::texture_decoder(std::size_t num_threads, std::size_t max_finished, int thumbnail_size)
+	: _max_finished(max_finished),
+	  _thumbnail_size(thumbnail_size) {
+	for(std::size_t i = 0; i < std::max((std::size_t) 1, num_threads); i++) {
+		_threads.emplace_back(&texture_decoder::run_worker, this);
+	}
+}
+
+texture_decoder::~texture_decoder() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_work_available.notify_all();
+	_space_available.notify_all();
+	for(std::thread& thread : _threads) {
+		thread.join();
+	}
+}
+
+void texture_decoder::request(const void* key, int tag, texture* tex) {
+	decode_request request { key, tag, tex->size(), tex->palette(), tex->pixel_data() };
+	tex->drop_decoded_data(); // The request has its own copy.
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_requests.emplace_back(std::move(request));
+	}
+	_work_available.notify_one();
+}
+
+std::optional<decoded_texture> texture_decoder::pop_finished() {
+	std::optional<decoded_texture> result;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if(_finished.empty()) {
+			return {};
+		}
+		result = std::move(_finished.front());
+		_finished.pop_front();
+	}
+	_space_available.notify_one();
+	return result;
+}
+
+void texture_decoder::clear() {
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_requests.clear();
+		_finished.clear();
+	}
+	_space_available.notify_all();
+}
+
+void texture_decoder::run_worker() {
+	std::unique_lock<std::mutex> lock(_mutex);
+	while(true) {
+		_work_available.wait(lock, [&]() { return _stopping || !_requests.empty(); });
+		if(_stopping) {
+			return;
+		}
+		decode_request request = std::move(_requests.back());
+		_requests.pop_back();
+
+		lock.unlock();
+		std::string cache_key = texture_thumbnail_key(request.size, request.palette, request.pixels);
+		std::optional<thumbnail> thumb = load_thumbnail(cache_key);
+		if(!thumb) {
+			std::vector<colour> rgba = expand_indexed_pixels(request.palette, request.pixels);
+			thumb = make_texture_thumbnail(request.size, rgba, _thumbnail_size);
+			save_thumbnail(cache_key, *thumb);
+		}
+		decoded_texture result { request.key, request.tag, thumb->size, std::move(thumb->pixels) };
+		lock.lock();
+
+		_space_available.wait(lock, [&]() { return _stopping || _finished.size() < _max_finished; });
+		if(_stopping) {
+			return;
+		}
+		_finished.emplace_back(std::move(result));
+	}
+}
@@ -0,0 +1,82 @@
+/*
+	wrench - A set of modding tools for the Ratchet & Clank PS2 games.
+	Copyright (C) 2019-2020 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef TEXTURE_DECODER_H
+#define TEXTURE_DECODER_H
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <optional>
+#include <condition_variable>
+
+#include "formats/texture.h"
+
+# /*
+#	Generates texture thumbnails on background threads so the GUI doesn't
+#	have to, loading them from the thumbnail cache where possible. Streams
+#	aren't thread safe, so the caller reads the palette and pixel data itself
+#	and only hands over copies.
+# */
+
+struct decoded_texture {
+	const void* key; // Identifies the texture for the caller.
+	int tag; // e.g. the project ID, so stale results can be dropped.
+	vec2i size; // Of the thumbnail.
+	std::vector<colour> rgba;
+};
+
+class texture_decoder {
+public:
+	// At most max_finished results are held at once. Workers wait for the
+	// caller to take some before decoding any more.
+	texture_decoder(std::size_t num_threads, std::size_t max_finished, int thumbnail_size);
+	~texture_decoder();
+
+	// Requests are handled newest first, since those are most likely to be
+	// for textures that are still on screen.
+	void request(const void* key, int tag, texture* tex);
+	std::optional<decoded_texture> pop_finished();
+
+	// Drop all requests that haven't been started and all finished results.
+	void clear();
+
+private:
+	struct decode_request {
+		const void* key;
+		int tag;
+		vec2i size;
+		std::array<colour, 256> palette;
+		std::vector<uint8_t> pixels;
+	};
+
+	void run_worker();
+
+	std::mutex _mutex;
+	std::condition_variable _work_available;
+	std::condition_variable _space_available;
+	std::deque<decode_request> _requests;
+	std::deque<decoded_texture> _finished;
+	std::size_t _max_finished;
+	int _thumbnail_size;
+	bool _stopping = false;
+	std::vector<std::thread> _threads;
+};
+
+#endif
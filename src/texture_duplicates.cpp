@@ -0,0 +1,56 @@
+/*
+	wrench - A set of modding tools for the Ratchet & Clank PS2 games.
+	Copyright (C) 2019-2020 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "texture_duplicates.h"
+
+texture_duplicates::texture_duplicates(const std::map<std::string, std::vector<texture>*>& lists) {
+	for(auto& [name, list] : lists) {
+		for(texture& tex : *list) {
+			_unindexed.push_back(&tex);
+		}
+	}
+}
+
+void texture_duplicates::index_some(std::chrono::steady_clock::duration time_budget) {
+	auto start_time = std::chrono::steady_clock::now();
+	while(_next < _unindexed.size() && std::chrono::steady_clock::now() - start_time < time_budget) {
+		texture* tex = _unindexed[_next++];
+		auto [group, inserted] = _group_of_hash.emplace(tex->hash(), _groups.size());
+		if(inserted) {
+			_groups.emplace_back();
+		}
+		_groups[group->second].push_back(tex);
+		_group_of[tex] = group->second;
+	}
+}
+
+std::vector<texture*> texture_duplicates::copies_of(texture* tex) const {
+	auto group = _group_of.find(tex);
+	if(group == _group_of.end()) {
+		return { tex };
+	}
+	return _groups[group->second];
+}
+
+texture* texture_duplicates::representative(texture* tex) const {
+	auto group = _group_of.find(tex);
+	if(group == _group_of.end()) {
+		return tex;
+	}
+	return _groups[group->second].front();
+}
@@ -0,0 +1,62 @@
+/*
+	wrench - A set of modding tools for the Ratchet & Clank PS2 games.
+	Copyright (C) 2019-2020 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef TEXTURE_DUPLICATES_H
+#define TEXTURE_DUPLICATES_H
+
+#include <map>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "formats/texture.h"
+
+# /*
+#	Groups textures with the same size, palette and pixel data, for example
+#	HUD textures that are stored again in every level. The texture browser
+#	decodes and uploads each group once, and can edit every copy at once.
+#	Hashing every texture takes a while, so it's done a little at a time.
+# */
+
+class texture_duplicates {
+public:
+	// Doesn't read anything yet.
+	texture_duplicates(const std::map<std::string, std::vector<texture>*>& lists);
+
+	// Hash textures until the time budget runs out or every texture has been
+	// indexed. Only keeps the hashes.
+	void index_some(std::chrono::steady_clock::duration time_budget);
+	bool finished() const { return _next == _unindexed.size(); }
+
+	// Including tex itself. A texture that hasn't been indexed has no copies.
+	std::vector<texture*> copies_of(texture* tex) const;
+	// The copy that decoded data should be shared through.
+	texture* representative(texture* tex) const;
+
+	std::size_t num_textures() const { return _group_of.size(); }
+	std::size_t num_unique() const { return _groups.size(); }
+
+private:
+	std::vector<texture*> _unindexed;
+	std::size_t _next = 0; // Index into _unindexed.
+	std::map<content_hash, std::size_t> _group_of_hash;
+	std::map<texture*, std::size_t> _group_of;
+	std::vector<std::vector<texture*>> _groups;
+};
+
+#endif
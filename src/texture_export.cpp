@@ -0,0 +1,304 @@
+/*
+	wrench - A set of modding tools for the Ratchet & Clank PS2 games.
+	Copyright (C) 2019-2020 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "texture_export.h"
+
+#include <mutex>
+#include <functional>
+#include <atomic>
+#include <optional>
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <boost/filesystem.hpp>
+
+#include "util.h"
+#include "formats/bmp.h"
+
+namespace fs = boost::filesystem;
+
+// Number of textures to read into memory before they're written out.
+static const std::size_t EXPORT_BATCH_SIZE = 256;
+
+// Bump this if the format of the manifest or the exported files changes.
+static const int EXPORT_MANIFEST_VERSION = 1;
+
+// Written alongside the exported files. Records the hash of the texture each
+// file was exported from, along with the file's size and modification time
+// so that files that have since been edited or replaced are exported again.
+struct export_manifest_entry {
+	content_hash hash;
+	uintmax_t size;
+	std::time_t modified;
+};
+
+using export_manifest = std::map<std::string, export_manifest_entry>; // Keyed by relative path.
+
+static export_manifest read_export_manifest(const fs::path& path) {
+	export_manifest manifest;
+	if(!fs::exists(path)) {
+		return manifest;
+	}
+	try {
+		std::ifstream file(path.string());
+		nlohmann::json json;
+		file >> json;
+		if(json["version"] != EXPORT_MANIFEST_VERSION) {
+			return manifest;
+		}
+		for(auto& [name, entry] : json["files"].items()) {
+			manifest[name] = {
+				{ entry["hash"][0].get<uint64_t>(), entry["hash"][1].get<uint64_t>() },
+				entry["size"].get<uintmax_t>(),
+				entry["modified"].get<std::time_t>()
+			};
+		}
+	} catch(nlohmann::json::exception& e) {
+		manifest.clear(); // Export everything again.
+	}
+	return manifest;
+}
+
+static void write_export_manifest(const fs::path& path, const export_manifest& manifest) {
+	nlohmann::json files = nlohmann::json::object();
+	for(auto& [name, entry] : manifest) {
+		files[name] = {
+			{ "hash", { entry.hash.lanes[0], entry.hash.lanes[1] } },
+			{ "size", entry.size },
+			{ "modified", entry.modified }
+		};
+	}
+	nlohmann::json json;
+	json["version"] = EXPORT_MANIFEST_VERSION;
+	json["files"] = files;
+	std::string json_str = json.dump(1, '\t');
+	std::ofstream file(path.string(), std::ios::trunc);
+	file.write(json_str.data(), json_str.size());
+}
+
+// The size and modification time of a file, or nothing if it doesn't exist.
+static std::optional<std::pair<uintmax_t, std::time_t>> file_stamp(const fs::path& path) {
+	boost::system::error_code error;
+	uintmax_t size = fs::file_size(path, error);
+	if(error) {
+		return {};
+	}
+	std::time_t modified = fs::last_write_time(path, error);
+	if(error) {
+		return {};
+	}
+	return std::make_pair(size, modified);
+}
+
+texture_export_result export_texture_lists(
+		const std::map<std::string, std::vector<texture>*>& lists,
+		std::string dest_dir,
+		std::size_t num_threads) {
+	struct export_job {
+		texture* tex;
+		std::string name; // Relative to dest_dir.
+		fs::path path;
+		content_hash hash;
+		bmp_indexed_image image;
+	};
+
+	std::vector<export_job> jobs;
+	for(auto& list : lists) {
+		fs::path list_dir = fs::path(dest_dir) / list.first;
+		fs::create_directories(list_dir);
+		std::vector<texture>& textures = *list.second;
+		for(std::size_t i = 0; i < textures.size(); i++) {
+			std::string file_name = sanitise_file_name(std::to_string(i) + "_" + textures[i].pixel_data_path() + ".bmp");
+			std::string name = list.first + "/" + file_name;
+			jobs.push_back({ &textures[i], name, list_dir / file_name, {}, {} });
+		}
+	}
+
+	fs::path manifest_path = fs::path(dest_dir) / "export_manifest.json";
+	export_manifest old_manifest = read_export_manifest(manifest_path);
+	export_manifest new_manifest;
+
+	texture_export_result result;
+	std::atomic<std::size_t> written(0);
+	std::atomic<std::size_t> failed(0);
+	std::mutex mutex; // For std::cerr and new_manifest.
+
+	for(std::size_t batch_begin = 0; batch_begin < jobs.size(); batch_begin += EXPORT_BATCH_SIZE) {
+		std::size_t batch_end = std::min(batch_begin + EXPORT_BATCH_SIZE, jobs.size());
+
+		// Textures share their backing streams, so they have to be read on
+		// this thread. Textures that haven't changed since the file was
+		// written are skipped without being decoded.
+		std::vector<bool> needs_write(batch_end - batch_begin);
+		for(std::size_t i = batch_begin; i < batch_end; i++) {
+			export_job& job = jobs[i];
+			try {
+				job.hash = job.tex->hash();
+				auto old_entry = old_manifest.find(job.name);
+				auto stamp = file_stamp(job.path);
+				if(old_entry != old_manifest.end() && old_entry->second.hash == job.hash && stamp &&
+						stamp->first == old_entry->second.size && stamp->second == old_entry->second.modified) {
+					new_manifest[job.name] = old_entry->second;
+					result.up_to_date++;
+					continue;
+				}
+				job.image = bmp_image_from_texture(job.tex);
+				job.tex->drop_decoded_data(); // The image has its own copy.
+				needs_write[i - batch_begin] = true;
+			} catch(stream_error& e) {
+				std::cerr << "Error: Failed to read " << job.path.string() << ": " << e.what() << "\n";
+				failed++;
+			}
+		}
+
+		parallel_for(batch_end - batch_begin, num_threads, [&](std::size_t i) {
+			if(!needs_write[i]) {
+				return;
+			}
+			export_job& job = jobs[batch_begin + i];
+			try {
+				array_stream bmp;
+				write_indexed_bmp(bmp, job.image, 0x3713);
+				{
+					file_stream dest(job.path.string(), std::ios::in | std::ios::out | std::ios::trunc);
+					dest.write_n(bmp.data(), bmp.size());
+				}
+				written++;
+				auto stamp = file_stamp(job.path);
+				if(stamp) {
+					std::lock_guard<std::mutex> lock(mutex);
+					new_manifest[job.name] = { job.hash, stamp->first, stamp->second };
+				}
+			} catch(stream_error& e) {
+				failed++;
+				std::lock_guard<std::mutex> lock(mutex);
+				std::cerr << "Error: Failed to write " << job.path.string() << ": " << e.what() << "\n";
+			}
+			job.image = {};
+		});
+	}
+
+	write_export_manifest(manifest_path, new_manifest);
+
+	result.written = written;
+	result.failed = failed;
+	return result;
+}
+
+// Compare the colours only, since BMP files don't store alpha.
+static bool texture_matches_image(texture* tex, const bmp_indexed_image& image) {
+	bmp_indexed_image current = bmp_image_from_texture(tex);
+	for(int i = 0; i < 256; i++) {
+		auto& lhs = current.palette[i];
+		auto& rhs = image.palette[i];
+		if(lhs.r != rhs.r || lhs.g != rhs.g || lhs.b != rhs.b) {
+			return false;
+		}
+	}
+	return current.pixels == image.pixels;
+}
+
+texture_import_result import_texture_lists(
+		const std::map<std::string, std::vector<texture>*>& lists,
+		std::string src_dir,
+		iso_stream& iso,
+		bool dither,
+		std::size_t num_threads) {
+	struct import_job {
+		texture* tex;
+		fs::path path;
+		std::optional<bmp_indexed_image> image;
+	};
+
+	texture_import_result result;
+
+	std::vector<import_job> jobs;
+	for(auto& list : lists) {
+		fs::path list_dir = fs::path(src_dir) / list.first;
+		if(!fs::is_directory(list_dir)) {
+			continue;
+		}
+		std::vector<texture>& textures = *list.second;
+		for(auto iter = fs::directory_iterator(list_dir); iter != fs::directory_iterator(); iter++) {
+			fs::path path = iter->path();
+			if(!fs::is_regular_file(path) || path.extension() != ".bmp") {
+				continue;
+			}
+			std::string name = path.filename().string();
+			std::size_t index;
+			try {
+				index = std::stoul(name.substr(0, name.find('_')));
+			} catch(std::logic_error&) {
+				index = textures.size();
+			}
+			if(index >= textures.size()) {
+				std::cerr << "Warning: Skipping " << path.string() << " as its name doesn't start with a valid index.\n";
+				continue;
+			}
+			jobs.push_back({ &textures[index], path, {} });
+		}
+	}
+
+	std::mutex cerr_mutex;
+	std::atomic<std::size_t> failed(0);
+	parallel_for(jobs.size(), num_threads, [&](std::size_t i) {
+		try {
+			file_stream src(jobs[i].path.string());
+			jobs[i].image = read_indexed_bmp(src, dither);
+		} catch(stream_error& e) {
+			failed++;
+			std::lock_guard<std::mutex> lock(cerr_mutex);
+			std::cerr << "Error: Failed to read " << jobs[i].path.string() << ": " << e.what() << "\n";
+		}
+	});
+	result.failed = failed;
+
+	// Apply the writes one segment at a time so the patches for each segment
+	// can be merged once they've all been made.
+	std::stable_sort(jobs.begin(), jobs.end(),
+		[](const import_job& lhs, const import_job& rhs) { return std::less<stream*>()(lhs.tex->backing(), rhs.tex->backing()); });
+	for(std::size_t i = 0; i < jobs.size(); i++) {
+		import_job& job = jobs[i];
+		wad_stream* segment = dynamic_cast<wad_stream*>(job.tex->backing());
+		if(job.image) {
+			try {
+				if(segment != nullptr && segment->discard) {
+					// See the comment for wad_stream::discard in iso_stream.h.
+					std::cerr << "Warning: Skipping " << job.path.string() << " as the segment it's stored in can't be recompressed yet.\n";
+				} else if(texture_matches_image(job.tex, *job.image)) {
+					result.unchanged++;
+				} else {
+					bmp_image_to_texture(job.tex, *job.image);
+					result.imported++;
+				}
+			} catch(stream_error& e) {
+				std::cerr << "Error: Failed to import " << job.path.string() << ": " << e.what() << "\n";
+				result.failed++;
+			}
+			job.image = {};
+		}
+		bool last_in_segment = i + 1 == jobs.size() || jobs[i + 1].tex->backing() != job.tex->backing();
+		if(segment != nullptr && last_in_segment) {
+			segment->coalesce_patches();
+		}
+	}
+
+	iso.commit(num_threads);
+
+	return result;
+}
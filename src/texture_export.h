@@ -0,0 +1,67 @@
+/*
+	wrench - A set of modding tools for the Ratchet & Clank PS2 games.
+	Copyright (C) 2019-2020 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef TEXTURE_EXPORT_H
+#define TEXTURE_EXPORT_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "iso_stream.h"
+#include "formats/texture.h"
+
+# /*
+#	Export whole texture lists to BMP files at once and import them back, for
+#	when going through the texture browser one texture at a time won't do.
+# */
+
+struct texture_export_result {
+	std::size_t written = 0;
+	std::size_t up_to_date = 0;
+	std::size_t failed = 0;
+};
+
+// Writes each texture to <dest_dir>/<list name>/<index>_<resource path>.bmp.
+// The hash of each texture is recorded in <dest_dir>/export_manifest.json,
+// so exporting the same lists again only decodes and writes the textures
+// that changed, and any files that were edited or deleted since.
+texture_export_result export_texture_lists(
+	const std::map<std::string, std::vector<texture>*>& lists,
+	std::string dest_dir,
+	std::size_t num_threads);
+
+struct texture_import_result {
+	std::size_t imported = 0;
+	std::size_t unchanged = 0;
+	std::size_t failed = 0;
+};
+
+// Reads a directory laid out like the output of export_texture_lists (only
+// the list directories and the index prefixes matter) back into the lists.
+// The BMP files are parsed in parallel, the writes are grouped by WAD
+// segment, and then each modified segment is recompressed once. Truecolour
+// files are quantised, with dithering if requested.
+texture_import_result import_texture_lists(
+	const std::map<std::string, std::vector<texture>*>& lists,
+	std::string src_dir,
+	iso_stream& iso,
+	bool dither,
+	std::size_t num_threads);
+
+#endif
@@ -0,0 +1,266 @@
+/*
+	wrench - A set of modding tools for the Ratchet & Clank PS2 games.
+	Copyright (C) 2019-2020 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "texture_index.h"
+
+#include <array>
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <boost/filesystem.hpp>
+
+#include "util.h"
+#include "game_db.h"
+#include "formats/wad.h"
+#include "formats/fip.h"
+#include "formats/level_impl.h"
+
+namespace fs = boost::filesystem;
+
+// Bump this if the format of the cache file or the hash function changes.
+static const int TEXTURE_INDEX_VERSION = 2;
+
+// Larger textures are assumed to be garbage.
+static const std::size_t MAX_TEXTURE_PIXELS = 0x400000;
+
+std::vector<const texture_index_entry*> texture_index::find(uint64_t hash) const {
+	auto range = std::equal_range(entries.begin(), entries.end(), texture_index_entry { hash },
+		[](const texture_index_entry& lhs, const texture_index_entry& rhs) { return lhs.hash < rhs.hash; });
+	std::vector<const texture_index_entry*> result;
+	for(auto iter = range.first; iter != range.second; iter++) {
+		result.push_back(&(*iter));
+	}
+	return result;
+}
+
+uint64_t palette_invariant_hash(const uint8_t* pixels, std::size_t width, std::size_t height) {
+	// 64-bit FNV-1a.
+	uint64_t hash = 0xcbf29ce484222325;
+	auto mix = [&](uint64_t value) {
+		hash ^= value;
+		hash *= 0x100000001b3;
+	};
+
+	mix(width);
+	mix(height);
+
+	std::array<int16_t, 256> labels;
+	labels.fill(-1);
+	int16_t next_label = 0;
+	for(std::size_t i = 0; i < width * height; i++) {
+		int16_t& label = labels[pixels[i]];
+		if(label == -1) {
+			label = next_label++;
+		}
+		mix(label);
+	}
+
+	return hash;
+}
+
+static std::vector<texture_index_entry> index_fip_texture(stream& src, const catalogue_object& object) {
+	std::size_t pixel_offset = object.header_offset + sizeof(fip_header);
+
+	fip_header header;
+	array_stream segment;
+	if(object.compressed) {
+		decompress_wad_prefix(segment, src, object.offset, pixel_offset);
+		header = segment.read<fip_header>(object.header_offset);
+	} else {
+		header = src.read<fip_header>(object.offset + object.header_offset);
+	}
+
+	std::size_t num_pixels = (std::size_t) header.width * header.height;
+	if(num_pixels == 0 || num_pixels > MAX_TEXTURE_PIXELS) {
+		return {};
+	}
+
+	std::vector<uint8_t> pixels(num_pixels);
+	if(object.compressed) {
+		decompress_wad_prefix(segment, src, object.offset, pixel_offset + num_pixels);
+		segment.seek(pixel_offset);
+		segment.read_v(pixels);
+	} else {
+		src.seek(object.offset + pixel_offset);
+		src.read_v(pixels);
+	}
+
+	return { {
+		palette_invariant_hash(pixels.data(), header.width, header.height),
+		header.width,
+		header.height,
+		object.offset,
+		object.compressed,
+		pixel_offset,
+		"fip"
+	} };
+}
+
+// Same layout as the texture tables read by level::level.
+static std::vector<texture_index_entry> index_level_textures(stream& src, const gamedb_file& file) {
+	packed_struct(texture_entry,
+		uint32_t ptr;
+		uint16_t width;
+		uint16_t height;
+		uint32_t palette;
+		uint32_t field_c;
+	);
+
+	proxy_stream backing(&src, file.offset, file.size);
+	auto file_header = backing.read<level::fmt::file_header>(0);
+	uint32_t primhdr_offset = file_header.primary_header.bytes();
+	auto primary_header = backing.read<level::fmt::primary_header>(primhdr_offset);
+	uint32_t snd_base = primhdr_offset + primary_header.snd_header.value;
+	auto snd_header = backing.read<level::fmt::secondary_header>(snd_base);
+
+	std::size_t asset_wad_offset = file.offset + primhdr_offset + primary_header.asset_wad.value;
+	array_stream asset_wad;
+	decompress_wad_prefix(asset_wad, src, asset_wad_offset, 0);
+
+	struct texture_table {
+		const char* name;
+		uint32_t offset;
+		uint32_t count;
+	};
+	texture_table tables[] = {
+		{ "Terrain", snd_header.terrain_texture_offset, snd_header.terrain_texture_count },
+		{ "Ties",    snd_header.tie_texture_offset,     snd_header.tie_texture_count },
+		{ "Sprites", snd_header.sprite_texture_offset,  snd_header.sprite_texture_count }
+	};
+
+	std::vector<texture_index_entry> result;
+	for(texture_table& table : tables) {
+		std::vector<texture_entry> entries(table.count);
+		backing.seek(snd_base + table.offset);
+		backing.read_v(entries);
+		for(texture_entry& entry : entries) {
+			std::size_t pixel_offset = snd_header.tex_data_in_asset_wad + entry.ptr;
+			std::size_t num_pixels = (std::size_t) entry.width * entry.height;
+			if(num_pixels == 0 || num_pixels > MAX_TEXTURE_PIXELS || pixel_offset + num_pixels > asset_wad.size()) {
+				continue;
+			}
+			result.push_back({
+				palette_invariant_hash(reinterpret_cast<uint8_t*>(asset_wad.data()) + pixel_offset, entry.width, entry.height),
+				entry.width,
+				entry.height,
+				asset_wad_offset,
+				true,
+				pixel_offset,
+				file.name + "/" + table.name
+			});
+		}
+	}
+	return result;
+}
+
+texture_index build_texture_index(std::string path, const disc_catalogue& catalogue, std::string game_id, std::size_t num_threads) {
+	std::vector<const catalogue_object*> fips = catalogue.objects_of_type("fip");
+
+	std::vector<gamedb_file> levels;
+	if(game_id != "") {
+		std::vector<gamedb_file> files = gamedb_parse_file().at(game_id).files;
+		catalogue.resolve_file_sizes(files);
+		std::copy_if(files.begin(), files.end(), std::back_inserter(levels),
+			[](gamedb_file& file) { return file.type == +gamedb_file_type::LEVEL; });
+	}
+
+	// Levels come first since they take the longest.
+	std::vector<std::vector<texture_index_entry>> results(levels.size() + fips.size());
+	parallel_for(results.size(), num_threads, [&](std::size_t i) {
+		file_stream src(path);
+		try {
+			if(i < levels.size()) {
+				results[i] = index_level_textures(src, levels[i]);
+			} else {
+				results[i] = index_fip_texture(src, *fips[i - levels.size()]);
+			}
+		} catch(stream_error& e) {
+			std::size_t offset = i < levels.size() ? levels[i].offset : fips[i - levels.size()]->offset;
+			std::cerr << "Warning: Failed to index texture(s) at 0x" << std::hex << offset << std::dec << ": " << e.what() << "\n";
+		}
+	});
+
+	texture_index index;
+	index.fingerprint = catalogue.fingerprint;
+	for(std::vector<texture_index_entry>& result : results) {
+		index.entries.insert(index.entries.end(), result.begin(), result.end());
+	}
+	std::stable_sort(index.entries.begin(), index.entries.end(),
+		[](const texture_index_entry& lhs, const texture_index_entry& rhs) { return lhs.hash < rhs.hash; });
+	return index;
+}
+
+texture_index open_texture_index(std::string path, const disc_catalogue& catalogue, std::string game_id, std::size_t num_threads) {
+	std::string cache_path = std::string("cache/texture_index_") + catalogue.fingerprint;
+	if(game_id != "") {
+		cache_path += "_" + game_id;
+	}
+	cache_path += ".json";
+
+	if(fs::exists(cache_path)) {
+		try {
+			std::ifstream cache_file(cache_path);
+			nlohmann::json json;
+			cache_file >> json;
+			if(json["version"] == TEXTURE_INDEX_VERSION && json["fingerprint"] == catalogue.fingerprint) {
+				texture_index index;
+				index.fingerprint = catalogue.fingerprint;
+				for(const nlohmann::json& entry : json["entries"]) {
+					index.entries.push_back({
+						entry["hash"].get<uint64_t>(),
+						entry["width"].get<std::size_t>(),
+						entry["height"].get<std::size_t>(),
+						entry["offset"].get<std::size_t>(),
+						entry["compressed"].get<bool>(),
+						entry["pixel_offset"].get<std::size_t>(),
+						entry["source"].get<std::string>()
+					});
+				}
+				return index;
+			}
+		} catch(nlohmann::json::exception& e) {
+			// Fall through and rebuild it.
+		}
+	}
+
+	texture_index index = build_texture_index(path, catalogue, game_id, num_threads);
+
+	std::vector<nlohmann::json> entries;
+	for(texture_index_entry& entry : index.entries) {
+		entries.emplace_back(nlohmann::json {
+			{ "hash", entry.hash },
+			{ "width", entry.width },
+			{ "height", entry.height },
+			{ "offset", entry.offset },
+			{ "compressed", entry.compressed },
+			{ "pixel_offset", entry.pixel_offset },
+			{ "source", entry.source }
+		});
+	}
+	nlohmann::json json;
+	json["version"] = TEXTURE_INDEX_VERSION;
+	json["fingerprint"] = index.fingerprint;
+	json["entries"] = entries;
+
+	fs::create_directories("cache");
+	std::string json_str = json.dump(1, '\t');
+	std::ofstream cache_file(cache_path, std::ios::trunc);
+	cache_file.write(json_str.data(), json_str.size());
+
+	return index;
+}
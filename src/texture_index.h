@@ -0,0 +1,63 @@
+/*
+	wrench - A set of modding tools for the Ratchet & Clank PS2 games.
+	Copyright (C) 2019-2020 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef TEXTURE_INDEX_H
+#define TEXTURE_INDEX_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "disc_catalogue.h"
+
+# /*
+#	Index of every indexed colour texture on a disc, keyed by a hash of the
+#	pixel data that doesn't depend on the palette. This lets texturefinder
+#	find a texture even if it was dumped with a different palette. Cached in
+#	the cache/ directory alongside the disc catalogue.
+# */
+
+struct texture_index_entry {
+	uint64_t hash;
+	std::size_t width;
+	std::size_t height;
+	std::size_t offset; // Of the segment on disc.
+	bool compressed; // Is the segment a WAD?
+	std::size_t pixel_offset; // Relative to the (decompressed) segment.
+	std::string source; // e.g. "fip" or "<level name>/Terrain".
+};
+
+struct texture_index {
+	std::string fingerprint;
+	std::vector<texture_index_entry> entries; // Sorted by hash.
+
+	std::vector<const texture_index_entry*> find(uint64_t hash) const;
+};
+
+// Indices are relabelled in order of first appearance before hashing, so two
+// images that only differ by a permutation of their palette hash the same.
+uint64_t palette_invariant_hash(const uint8_t* pixels, std::size_t width, std::size_t height);
+
+// Index all the 2FIP textures in the catalogue, and if a game ID is given the
+// terrain, tie and sprite textures of each of its levels.
+texture_index build_texture_index(std::string path, const disc_catalogue& catalogue, std::string game_id, std::size_t num_threads);
+
+// Load the index from the cache, or build it and save it to the cache.
+texture_index open_texture_index(std::string path, const disc_catalogue& catalogue, std::string game_id, std::size_t num_threads);
+
+#endif
@@ -0,0 +1,186 @@
+/*
+	wrench - A set of modding tools for the Ratchet & Clank PS2 games.
+	Copyright (C) 2019-2020 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "thumbnail_cache.h"
+
+#include <ctime>
+#include <thread>
+#include <cstring>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <boost/filesystem.hpp>
+
+#include "util.h"
+
+namespace fs = boost::filesystem;
+
+static const char* THUMBNAIL_DIR = "cache/thumbnails";
+
+packed_struct(thumbnail_header,
+	char magic[4]; // "THMB"
+	uint32_t width;
+	uint32_t height;
+)
+
+std::string thumbnail_key(const char* kind, const std::vector<std::pair<const void*, std::size_t>>& data) {
+	content_hasher hasher;
+	for(auto& [ptr, size] : data) {
+		hasher.update(ptr, size);
+	}
+
+	std::stringstream result;
+	result << kind << "_" << std::hex << std::setfill('0');
+	for(uint64_t lane : hasher.digest().lanes) {
+		result << std::setw(16) << lane;
+	}
+	return result.str();
+}
+
+std::string texture_thumbnail_key(vec2i size, const std::array<colour, 256>& palette, const std::vector<uint8_t>& pixels) {
+	return thumbnail_key("texture1", {
+		{ &size, sizeof(vec2i) },
+		{ palette.data(), sizeof(colour) * palette.size() },
+		{ pixels.data(), pixels.size() }
+	});
+}
+
+static fs::path thumbnail_path(const std::string& key) {
+	return fs::path(THUMBNAIL_DIR) / (key + ".thumb");
+}
+
+std::optional<thumbnail> load_thumbnail(const std::string& key) {
+	fs::path path = thumbnail_path(key);
+	if(!fs::exists(path)) {
+		return {};
+	}
+
+	try {
+		file_stream file(path.string());
+		auto header = file.read<thumbnail_header>(0);
+		if(std::memcmp(header.magic, "THMB", 4) != 0 || header.width > 0x1000 || header.height > 0x1000) {
+			return {};
+		}
+		thumbnail thumb;
+		thumb.size = { (int) header.width, (int) header.height };
+		thumb.pixels.resize(header.width * header.height);
+		file.read_v(thumb.pixels);
+		
+		// Thumbnails are evicted by modification time.
+		boost::system::error_code error;
+		fs::last_write_time(path, std::time(nullptr), error);
+		return thumb;
+	} catch(stream_error& e) {
+		return {}; // Probably truncated. It will be overwritten.
+	}
+}
+
+void save_thumbnail(const std::string& key, const thumbnail& thumb) {
+	thumbnail_header header;
+	std::memcpy(header.magic, "THMB", 4);
+	header.width = thumb.size.x;
+	header.height = thumb.size.y;
+
+	// Write to a temporary file first so that other threads never see a
+	// partially written thumbnail.
+	std::stringstream temp_name;
+	temp_name << key << "." << std::this_thread::get_id() << ".tmp";
+	fs::path temp_path = fs::path(THUMBNAIL_DIR) / temp_name.str();
+
+	try {
+		fs::create_directories(THUMBNAIL_DIR);
+		{
+			file_stream file(temp_path.string(), std::ios::in | std::ios::out | std::ios::trunc);
+			file.write<thumbnail_header>(header);
+			file.write_v(thumb.pixels);
+		}
+		fs::rename(temp_path, thumbnail_path(key));
+	} catch(stream_error& e) {
+		// The cache is only an optimisation.
+	} catch(fs::filesystem_error& e) {}
+}
+
+void prune_thumbnail_cache(uintmax_t max_size) {
+	struct cache_file {
+		fs::path path;
+		std::time_t last_used;
+		uintmax_t size;
+	};
+	
+	boost::system::error_code error;
+	if(!fs::is_directory(THUMBNAIL_DIR, error)) {
+		return;
+	}
+	
+	std::vector<fs::path> paths;
+	for(auto iter = fs::directory_iterator(THUMBNAIL_DIR, error); !error && iter != fs::directory_iterator(); iter.increment(error)) {
+		paths.push_back(iter->path());
+	}
+	
+	std::vector<cache_file> files;
+	uintmax_t total_size = 0;
+	for(fs::path& path : paths) {
+		boost::system::error_code file_error;
+		if(path.extension() == ".tmp") {
+			fs::remove(path, file_error);
+			continue;
+		}
+		if(path.extension() != ".thumb") {
+			continue;
+		}
+		std::time_t last_used = fs::last_write_time(path, file_error);
+		if(file_error) {
+			continue;
+		}
+		uintmax_t size = fs::file_size(path, file_error);
+		if(file_error) {
+			continue;
+		}
+		files.push_back({ path, last_used, size });
+		total_size += size;
+	}
+	
+	std::sort(files.begin(), files.end(),
+		[](const cache_file& lhs, const cache_file& rhs) { return lhs.last_used < rhs.last_used; });
+	for(std::size_t i = 0; i < files.size() && total_size > max_size; i++) {
+		if(fs::remove(files[i].path, error)) {
+			total_size -= files[i].size;
+		}
+	}
+}
+
+thumbnail make_texture_thumbnail(vec2i size, const std::vector<colour>& rgba, int max_size) {
+	int largest_side = std::max(size.x, size.y);
+	if(largest_side <= max_size) {
+		return { size, rgba };
+	}
+
+	thumbnail thumb;
+	thumb.size = {
+		std::max(1, size.x * max_size / largest_side),
+		std::max(1, size.y * max_size / largest_side)
+	};
+	thumb.pixels.resize(thumb.size.x * thumb.size.y);
+	for(int y = 0; y < thumb.size.y; y++) {
+		const colour* src_row = &rgba[(y * size.y / thumb.size.y) * size.x];
+		for(int x = 0; x < thumb.size.x; x++) {
+			thumb.pixels[y * thumb.size.x + x] = src_row[x * size.x / thumb.size.x];
+		}
+	}
+	return thumb;
+}
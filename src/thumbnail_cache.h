@@ -0,0 +1,58 @@
+/*
+	wrench - A set of modding tools for the Ratchet & Clank PS2 games.
+	Copyright (C) 2019-2020 chaoticgd
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef THUMBNAIL_CACHE_H
+#define THUMBNAIL_CACHE_H
+
+#include <array>
+#include <string>
+#include <vector>
+#include <optional>
+
+#include "formats/texture.h"
+
+# /*
+#	Small RGBA previews of textures and models, stored in cache/thumbnails/
+#	and keyed by a hash of whatever they were generated from, so the browsers
+#	don't have to regenerate them every time a project is opened.
+# */
+
+struct thumbnail {
+	vec2i size;
+	std::vector<colour> pixels;
+};
+
+// kind should change whenever the way a kind of thumbnail is generated does,
+// so that old thumbnails aren't reused.
+std::string thumbnail_key(const char* kind, const std::vector<std::pair<const void*, std::size_t>>& data);
+std::string texture_thumbnail_key(vec2i size, const std::array<colour, 256>& palette, const std::vector<uint8_t>& pixels);
+
+// Also marks the thumbnail as recently used.
+std::optional<thumbnail> load_thumbnail(const std::string& key);
+// Safe to call from multiple threads, even with the same key.
+void save_thumbnail(const std::string& key, const thumbnail& thumb);
+
+// Delete the least recently used thumbnails until the cache is no larger than
+// max_size bytes, along with any temporary files left behind by a crash. Call
+// this on startup, before anything else uses the cache.
+void prune_thumbnail_cache(uintmax_t max_size);
+
+// Nearest neighbour downscale so that neither side is larger than max_size.
+thumbnail make_texture_thumbnail(vec2i size, const std::vector<colour>& rgba, int max_size);
+
+#endif
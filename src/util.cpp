@@ -18,7 +18,12 @@
 
 #include "util.h"
 
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <cstring>
 #include <sstream>
+#include <exception>
 
 std::string int_to_hex(std::size_t x) {
 	std::stringstream ss;
@@ -46,7 +51,7 @@ std::size_t parse_number(std::string x) {
 	return result;
 }
 
-std::vector<std::string> to_hex_dump(uint32_t* data, std::size_t align, std::size_t size_in_u32s) {
+std::vector<std::string> to_hex_dump(const uint32_t* data, std::size_t align, std::size_t size_in_u32s) {
 	std::vector<std::string> result;
 	std::size_t column = align % 16;
 	std::string data_str(column * 3, ' ');
@@ -67,3 +72,77 @@ std::vector<std::string> to_hex_dump(uint32_t* data, std::size_t align, std::siz
 	}
 	return result;
 }
+
+std::string sanitise_file_name(std::string name) {
+	static const std::string forbidden = "<>:\"/\\|?*";
+	for(char& c : name) {
+		if(forbidden.find(c) != std::string::npos) {
+			c = '_';
+		}
+	}
+	return name;
+}
+
+// Two independent 64-bit lanes, fed a word at a time.
+void content_hasher::update(const void* data, std::size_t size) {
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	std::size_t i = 0;
+	for(; i + 8 <= size; i += 8) {
+		uint64_t word;
+		std::memcpy(&word, bytes + i, 8);
+		mix(word);
+	}
+	uint64_t tail = 0;
+	std::memcpy(&tail, bytes + i, size - i);
+	mix(tail ^ ((uint64_t) size << 56));
+}
+
+content_hash content_hasher::digest() const {
+	return { { _lanes[0], _lanes[1] } };
+}
+
+void content_hasher::mix(uint64_t word) {
+	_lanes[0] = (_lanes[0] ^ word) * 0xff51afd7ed558ccd;
+	_lanes[0] ^= _lanes[0] >> 32;
+	_lanes[1] = (_lanes[1] ^ word) * 0xc4ceb9fe1a85ec53;
+	_lanes[1] ^= _lanes[1] >> 29;
+}
+
+void parallel_for(std::size_t count, std::size_t num_threads, std::function<void(std::size_t)> callback) {
+	num_threads = std::max((std::size_t) 1, std::min(num_threads, count));
+	
+	std::atomic<std::size_t> next(0);
+	std::exception_ptr error;
+	std::mutex error_mutex;
+	
+	auto worker = [&]() {
+		for(std::size_t i = next++; i < count; i = next++) {
+			try {
+				callback(i);
+			} catch(...) {
+				std::lock_guard<std::mutex> lock(error_mutex);
+				if(!error) {
+					error = std::current_exception();
+				}
+				next = count; // Stop handing out work.
+			}
+		}
+	};
+	
+	std::vector<std::thread> threads;
+	for(std::size_t i = 1; i < num_threads; i++) {
+		threads.emplace_back(worker);
+	}
+	worker();
+	for(std::thread& thread : threads) {
+		thread.join();
+	}
+	
+	if(error) {
+		std::rethrow_exception(error);
+	}
+}
+
+std::size_t default_num_threads() {
+	return std::max(1u, std::thread::hardware_concurrency());
+}
@@ -23,6 +23,8 @@
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <functional>
+#include <stdint.h>
 
 # /*
 #	For things that should be in the standard library, but aren't.
@@ -32,6 +34,37 @@ std::string int_to_hex(std::size_t x);
 std::size_t hex_to_int(std::string x);
 std::size_t parse_number(std::string x);
 
-std::vector<std::string> to_hex_dump(uint32_t* data, std::size_t align, std::size_t size_in_u32s);
+std::vector<std::string> to_hex_dump(const uint32_t* data, std::size_t align, std::size_t size_in_u32s);
+
+// Replace characters that aren't allowed in file names (on certain platforms).
+std::string sanitise_file_name(std::string name);
+
+// Not cryptographic, but fast enough to hash every texture in a project.
+struct content_hash {
+	uint64_t lanes[2];
+
+	bool operator==(const content_hash& rhs) const { return lanes[0] == rhs.lanes[0] && lanes[1] == rhs.lanes[1]; }
+	bool operator!=(const content_hash& rhs) const { return !(*this == rhs); }
+	bool operator<(const content_hash& rhs) const {
+		return lanes[0] < rhs.lanes[0] || (lanes[0] == rhs.lanes[0] && lanes[1] < rhs.lanes[1]);
+	}
+};
+
+class content_hasher {
+public:
+	void update(const void* data, std::size_t size);
+	content_hash digest() const;
+
+private:
+	void mix(uint64_t word);
+
+	uint64_t _lanes[2] = { 0x9e3779b97f4a7c15, 0xc2b2ae3d27d4eb4f };
+};
+
+// Call callback(i) for each i in [0, count) using at most num_threads threads.
+// If a callback throws, the first exception is rethrown on the calling thread
+// after all the other threads have finished.
+void parallel_for(std::size_t count, std::size_t num_threads, std::function<void(std::size_t)> callback);
+std::size_t default_num_threads();
 
 #endif